@@ -0,0 +1,164 @@
+/*
+  ==============================================================================
+
+    EngineRender.cpp
+
+  ==============================================================================
+*/
+
+#include "EngineRender.h"
+
+//==============================================================================
+bool loadState(const File& file, MemoryBlock& state)
+{
+    if (!file.loadFileAsData(state)) return false;
+    
+    // Preset XML rather than a state blob from getStateInformation
+    if (state.getSize() > 0 && *(const char*)state.getData() == '<')
+    {
+        std::unique_ptr<XmlElement> xml = parseXML(file);
+        if (xml == nullptr) return false;
+        for (int i = 0; i < NUM_OSCS; ++i)
+        {
+            String name = "osc" + String(i+1) + "File";
+            String path = xml->getStringAttribute(name);
+            if (path.isNotEmpty() && !File::isAbsolutePath(path))
+            {
+                xml->setAttribute(name, file.getSiblingFile(path).getFullPathName());
+            }
+        }
+        state.reset();
+        AudioProcessor::copyXmlToBinary(*xml, state);
+    }
+    return true;
+}
+
+MidiMessageSequence createSyntheticNotes(ESAudioProcessor& processor, int numVoices,
+                                         double seconds)
+{
+    MidiMessageSequence sequence;
+    bool mpe = processor.getMPEMode();
+    
+    for (int v = 0; v < numVoices; ++v)
+    {
+        int channel = mpe ? processor.stringChannels[v+1] : 1;
+        double offset = v * 0.037;
+        
+        int cycle = 0;
+        for (double t = offset; t < seconds; t += 2.0, ++cycle)
+        {
+            int key = 40 + (v * 5 + cycle * 7) % 36;
+            float velocity = 0.5f + 0.5f * ((v + cycle) % 5) / 4.f;
+            sequence.addEvent(MidiMessage::noteOn(channel, key, velocity), t);
+            sequence.addEvent(MidiMessage::noteOff(channel, key), t + 1.6);
+        }
+        
+        // Only per string bends in MPE mode; the global channel otherwise
+        if (mpe || v == 0)
+        {
+            for (double t = offset; t < seconds; t += 0.01)
+            {
+                int bend = 8192 + (int)(2000.0 * std::sin(MathConstants<double>::twoPi * 0.5 * t + v));
+                sequence.addEvent(MidiMessage::pitchWheel(channel, bend), t);
+            }
+        }
+    }
+    
+    sequence.sort();
+    return sequence;
+}
+
+bool loadMidiFile(const File& file, double seconds, MidiMessageSequence& sequence)
+{
+    FileInputStream in (file);
+    MidiFile midi;
+    if (!in.openedOk() || !midi.readFrom(in)) return false;
+    midi.convertTimestampTicksToSeconds();
+    
+    MidiMessageSequence merged;
+    for (int t = 0; t < midi.getNumTracks(); ++t)
+    {
+        merged.addSequence(*midi.getTrack(t), 0.0);
+    }
+    double length = merged.getEndTime();
+    if (merged.getNumEvents() == 0 || length <= 0.0) return false;
+    
+    // Looped to cover the whole run, with a little gap so the last notes end
+    sequence.clear();
+    for (double offset = 0.0; offset < seconds; offset += length + 0.1)
+    {
+        sequence.addSequence(merged, offset);
+    }
+    sequence.updateMatchedPairs();
+    return true;
+}
+
+//==============================================================================
+void RenderTimings::addTo(DynamicObject& result, double sampleRate, int blockSize,
+                          int numVoices) const
+{
+    double seconds = Time::highResolutionTicksToSeconds(ticks);
+    double audioSeconds = numSamples / sampleRate;
+    double worst = Time::highResolutionTicksToSeconds(worstTicks);
+    double blockSeconds = blockSize / sampleRate;
+    
+    result.setProperty("blocks", numBlocks);
+    // Seconds of audio rendered per second of processing
+    result.setProperty("realtimeFactor", seconds > 0.0 ? audioSeconds / seconds : 0.0);
+    result.setProperty("nsPerSamplePerVoice", seconds * 1.0e9 / ((double)numSamples * numVoices));
+    result.setProperty("averageBlockMicros", seconds * 1.0e6 / jmax(1, numBlocks));
+    result.setProperty("worstBlockMicros", worst * 1.0e6);
+    // Share of the block's real time budget taken by the slowest block
+    result.setProperty("worstBlockLoad", worst / blockSeconds);
+}
+
+RenderTimings renderNotes(ESAudioProcessor& processor, const MidiMessageSequence& notes,
+                          double sampleRate, int blockSize, int64 numSamples,
+                          int64 untimedSamples, AudioBuffer<float>* output)
+{
+    RenderTimings timings;
+    
+    AudioBuffer<float> buffer (2, blockSize);
+    MidiBuffer midi;
+    midi.ensureSize(4096);
+    int nextEvent = 0;
+    
+    if (output != nullptr) output->setSize(2, (int)numSamples);
+    
+    for (int64 position = 0; position < numSamples; position += blockSize)
+    {
+        int n = (int)jmin((int64)blockSize, numSamples - position);
+        buffer.setSize(2, n, false, false, true);
+        
+        midi.clear();
+        double blockEnd = (position + n) / sampleRate;
+        while (nextEvent < notes.getNumEvents() &&
+               notes.getEventTime(nextEvent) < blockEnd)
+        {
+            const MidiMessage& m = notes.getEventPointer(nextEvent)->message;
+            int offset = (int)(m.getTimeStamp() * sampleRate - position);
+            midi.addEvent(m, jlimit(0, n - 1, offset));
+            nextEvent++;
+        }
+        
+        int64 start = Time::getHighResolutionTicks();
+        processor.processBlock(buffer, midi);
+        int64 elapsed = Time::getHighResolutionTicks() - start;
+        
+        if (output != nullptr)
+        {
+            for (int channel = 0; channel < 2; ++channel)
+            {
+                output->copyFrom(channel, (int)position, buffer, channel, 0, n);
+            }
+        }
+        
+        if (position < untimedSamples) continue;
+        timings.ticks += elapsed;
+        timings.worstTicks = jmax(timings.worstTicks, elapsed);
+        timings.numSamples += n;
+        timings.numBlocks++;
+    }
+    
+    return timings;
+}
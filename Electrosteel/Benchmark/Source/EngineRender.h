@@ -0,0 +1,48 @@
+/*
+  ==============================================================================
+
+    EngineRender.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+
+//==============================================================================
+// Driving ESAudioProcessor without a host, shared by the benchmark sweep and
+// the golden render suite.
+
+// Plugin state blob, or preset XML converted to one. Wavetable files in a
+// preset may be given relative to it
+bool loadState(const File& file, MemoryBlock& state);
+
+// Every string plays a new note every couple of seconds, staggered so there
+// are always attacks and releases in flight, with the bends a steel player
+// would be making throughout
+MidiMessageSequence createSyntheticNotes(ESAudioProcessor& processor, int numVoices,
+                                         double seconds);
+
+// All tracks merged, in seconds, looped to cover the given length
+bool loadMidiFile(const File& file, double seconds, MidiMessageSequence& sequence);
+
+//==============================================================================
+struct RenderTimings
+{
+    int64 ticks = 0;
+    int64 worstTicks = 0;
+    int64 numSamples = 0;
+    int numBlocks = 0;
+    
+    // Adds realtimeFactor, nsPerSamplePerVoice and block times to result
+    void addTo(DynamicObject& result, double sampleRate, int blockSize, int numVoices) const;
+};
+
+// Renders numSamples of notes in blocks of blockSize, timing each call to
+// processBlock once past untimedSamples. If output is given it's resized to
+// hold the whole render
+RenderTimings renderNotes(ESAudioProcessor& processor, const MidiMessageSequence& notes,
+                          double sampleRate, int blockSize, int64 numSamples,
+                          int64 untimedSamples, AudioBuffer<float>* output);
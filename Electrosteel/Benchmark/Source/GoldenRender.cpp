@@ -0,0 +1,191 @@
+/*
+  ==============================================================================
+
+    GoldenRender.cpp
+
+  ==============================================================================
+*/
+
+#include "GoldenRender.h"
+
+//==============================================================================
+static bool writeWav(const File& file, const AudioBuffer<float>& buffer, double sampleRate)
+{
+    // FileOutputStream appends
+    file.deleteFile();
+    std::unique_ptr<FileOutputStream> stream = file.createOutputStream();
+    if (stream == nullptr) return false;
+    
+    // 32 bit WAVs are float, so references are exact
+    WavAudioFormat wav;
+    std::unique_ptr<AudioFormatWriter> writer (wav.createWriterFor(stream.get(), sampleRate,
+                                                                   (unsigned int)buffer.getNumChannels(),
+                                                                   32, {}, 0));
+    if (writer == nullptr) return false;
+    stream.release();
+    return writer->writeFromAudioSampleBuffer(buffer, 0, buffer.getNumSamples());
+}
+
+static bool readWav(const File& file, AudioBuffer<float>& buffer)
+{
+    WavAudioFormat wav;
+    std::unique_ptr<AudioFormatReader> reader (wav.createReaderFor(new FileInputStream(file), true));
+    if (reader == nullptr) return false;
+    
+    buffer.setSize((int)reader->numChannels, (int)reader->lengthInSamples);
+    return reader->read(&buffer, 0, (int)reader->lengthInSamples, 0, true, true);
+}
+
+//==============================================================================
+enum GoldenMode
+{
+    GoldenLive = 0,
+    GoldenThreaded,
+    GoldenOffline
+};
+
+static var runCase(const GoldenOptions& options, const File& preset, const File& midiFile,
+                   GoldenMode mode, bool& passed)
+{
+    String name = (preset == File() ? String("default") : preset.getFileNameWithoutExtension())
+    + "_" + (midiFile == File() ? String("synthetic") : midiFile.getFileNameWithoutExtension());
+    // Offline renders have their own reference, threaded ones share the
+    // single threaded one
+    if (mode == GoldenOffline) name += "_offline";
+    File reference = options.directory.getChildFile(name + ".wav");
+    if (mode == GoldenThreaded) name += "_threaded";
+    
+    DynamicObject::Ptr result = new DynamicObject();
+    result->setProperty("name", name);
+    passed = false;
+    
+    ESAudioProcessor processor;
+    if (preset != File())
+    {
+        MemoryBlock state;
+        if (!loadState(preset, state))
+        {
+            result->setProperty("error", "Couldn't load " + preset.getFileName());
+            return var(result.get());
+        }
+        processor.setStateInformation(state.getData(), (int)state.getSize());
+        // Wavetables load in the background
+        if (!processor.waveTableLoader.waitUntilLoaded(10000))
+        {
+            result->setProperty("error", "Wavetables for " + preset.getFileName() + " didn't load");
+            return var(result.get());
+        }
+    }
+    processor.setRandomSeed(GOLDEN_SEED);
+    processor.setNumRenderThreads(mode == GoldenThreaded ? MAX_RENDER_THREADS : 1);
+    processor.setNonRealtime(mode == GoldenOffline);
+    processor.setPlayConfigDetails(0, 2, GOLDEN_SAMPLE_RATE, GOLDEN_BLOCK_SIZE);
+    processor.prepareToPlay(GOLDEN_SAMPLE_RATE, GOLDEN_BLOCK_SIZE);
+    
+    MidiMessageSequence notes;
+    if (midiFile == File()) notes = createSyntheticNotes(processor, NUM_STRINGS, options.seconds);
+    else if (!loadMidiFile(midiFile, options.seconds, notes))
+    {
+        result->setProperty("error", "Couldn't load " + midiFile.getFileName());
+        return var(result.get());
+    }
+    
+    AudioBuffer<float> rendered;
+    int64 numSamples = (int64)(options.seconds * GOLDEN_SAMPLE_RATE);
+    RenderTimings timings = renderNotes(processor, notes, GOLDEN_SAMPLE_RATE, GOLDEN_BLOCK_SIZE,
+                                        numSamples, 0, &rendered);
+    processor.releaseResources();
+    timings.addTo(*result, GOLDEN_SAMPLE_RATE, GOLDEN_BLOCK_SIZE, processor.numVoicesActive);
+    
+    if (options.update && mode != GoldenThreaded)
+    {
+        passed = writeWav(reference, rendered, GOLDEN_SAMPLE_RATE);
+        if (!passed) result->setProperty("error", "Couldn't write " + reference.getFileName());
+        return var(result.get());
+    }
+    
+    AudioBuffer<float> expected;
+    if (!readWav(reference, expected))
+    {
+        result->setProperty("error", "No reference " + reference.getFileName());
+        return var(result.get());
+    }
+    if (expected.getNumChannels() != rendered.getNumChannels() ||
+        expected.getNumSamples() != rendered.getNumSamples())
+    {
+        result->setProperty("error", "Reference " + reference.getFileName() + " is a different length");
+        return var(result.get());
+    }
+    
+    float maxError = 0.f;
+    int maxErrorSample = 0;
+    for (int channel = 0; channel < rendered.getNumChannels(); ++channel)
+    {
+        const float* a = rendered.getReadPointer(channel);
+        const float* b = expected.getReadPointer(channel);
+        for (int s = 0; s < rendered.getNumSamples(); ++s)
+        {
+            float error = fabsf(a[s] - b[s]);
+            // NaN never compares greater, so catch it separately
+            if (error > maxError || error != error)
+            {
+                maxError = error != error ? std::numeric_limits<float>::infinity() : error;
+                maxErrorSample = s;
+            }
+        }
+    }
+    
+    passed = maxError <= options.tolerance;
+    result->setProperty("maxError", maxError);
+    result->setProperty("maxErrorDb", Decibels::gainToDecibels(maxError, -200.f));
+    result->setProperty("maxErrorSample", maxErrorSample);
+    result->setProperty("passed", passed);
+    
+    // Keep the failed render next to the reference to listen to or diff
+    if (!passed)
+    {
+        writeWav(options.directory.getChildFile(name + ".actual.wav"), rendered, GOLDEN_SAMPLE_RATE);
+    }
+    
+    return var(result.get());
+}
+
+int runGoldenRenders(const GoldenOptions& options, DynamicObject& report)
+{
+    Array<File> presets = options.directory.findChildFiles(File::findFiles, false, "*.xml;*.state");
+    Array<File> midiFiles = options.directory.findChildFiles(File::findFiles, false, "*.mid");
+    presets.sort();
+    midiFiles.sort();
+    presets.insert(0, File());
+    midiFiles.insert(0, File());
+    
+    Array<var> results;
+    int numFailed = 0;
+    for (auto preset : presets)
+    {
+        for (auto midiFile : midiFiles)
+        {
+            // With --update the threaded render checks the reference just
+            // written by the live one
+            for (GoldenMode mode : { GoldenLive, GoldenThreaded, GoldenOffline })
+            {
+                if (mode == GoldenOffline && midiFile != File()) continue;
+                
+                bool passed;
+                results.add(runCase(options, preset, midiFile, mode, passed));
+                if (!passed) numFailed++;
+                std::cerr << results.getLast()["name"].toString() << (passed ? ": ok\n" : ": FAILED\n");
+            }
+        }
+    }
+    
+    report.setProperty("directory", options.directory.getFullPathName());
+    report.setProperty("update", options.update);
+    report.setProperty("tolerance", options.tolerance);
+    report.setProperty("seconds", options.seconds);
+    report.setProperty("sampleRate", GOLDEN_SAMPLE_RATE);
+    report.setProperty("blockSize", GOLDEN_BLOCK_SIZE);
+    report.setProperty("failed", numFailed);
+    report.setProperty("results", results);
+    return numFailed;
+}
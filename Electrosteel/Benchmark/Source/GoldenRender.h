@@ -0,0 +1,42 @@
+/*
+  ==============================================================================
+
+    GoldenRender.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "EngineRender.h"
+
+#define GOLDEN_SAMPLE_RATE 48000.0
+#define GOLDEN_BLOCK_SIZE 128
+#define GOLDEN_SEED 1
+// Largest sample difference that still passes, about -80dB
+#define GOLDEN_DEFAULT_TOLERANCE 0.0001
+
+//==============================================================================
+// Regression check for the audio output. Every preset in a directory (*.xml
+// preset or *.state blob, plus the default state) is rendered against every
+// note stream (*.mid, plus the synthetic notes) and compared with the stored
+// reference <preset>_<notes>.wav. Each is rendered three ways, with the
+// random generators seeded so they're repeatable:
+//   - live, on one render thread, which writes the reference with --update
+//   - live on MAX_RENDER_THREADS, against the same reference, as sharing
+//     strings out between threads mustn't change what they render
+//   - offline, only with the synthetic notes, against its own reference
+//     <preset>_synthetic_offline.wav
+// Timings are recorded for every case so an optimisation can be shown to be
+// both close enough and faster.
+struct GoldenOptions
+{
+    File directory;
+    // Write the references instead of checking against them
+    bool update = false;
+    double tolerance = GOLDEN_DEFAULT_TOLERANCE;
+    double seconds = 4.0;
+};
+
+// Fills report and returns the number of cases that failed
+int runGoldenRenders(const GoldenOptions& options, DynamicObject& report);
@@ -0,0 +1,282 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "EngineRender.h"
+#include "GoldenRender.h"
+#include "MathCheck.h"
+#include "SaturatorCheck.h"
+#include "SysexCheck.h"
+#include "WaveTableCheck.h"
+
+//==============================================================================
+// Headless throughput benchmark for the engine. Renders a synthetic or MIDI
+// file note stream through ESAudioProcessor, without an editor or audio
+// device, for every combination of block size, sample rate and voice count
+// asked for, and writes the timings as JSON. With --golden it instead runs
+// the golden render regression suite, see GoldenRender.h, with --math the
+// FastMath.h error bound check, see MathCheck.h, with --saturator the
+// output saturator's aliasing check, see SaturatorCheck.h, with --sysex the
+// packed sysex format check, see SysexCheck.h, and with --wavetable the
+// wavetable kernel check, see WaveTableCheck.h.
+
+static const char* const usage =
+"Usage: ESBenchmark [options]\n"
+"  --state=<file>           Plugin state blob or preset XML to load\n"
+"  --midi=<file>            MIDI file to play, looped (default synthetic notes)\n"
+"  --no-mpe                 Play in poly mode instead of MPE\n"
+"  --seconds=<n>            Seconds of audio timed per run (default 10)\n"
+"  --block-sizes=<list>     Comma separated (default 32,64,128,256,512)\n"
+"  --sample-rates=<list>    Comma separated (default 44100,48000,96000)\n"
+"  --voices=<list>          Comma separated numVoicesActive (default 1,6,12)\n"
+"  --threads=<n>            Render threads (default from state, else 1)\n"
+"  --offline                Render with the offline quality settings\n"
+"  --output=<file>          Write JSON here instead of stdout\n"
+"\n"
+"  --golden=<dir>           Check renders of the presets and MIDI files in dir\n"
+"                           against its reference WAVs; exits 1 on a mismatch\n"
+"  --update                 Write the reference WAVs instead of checking them\n"
+"  --tolerance=<x>          Largest sample difference allowed (default 0.0001)\n"
+"  --seconds=<n>            Seconds rendered per case (default 4)\n"
+"\n"
+"  --math                   Check FastMath.h against libm; exits 1 if any\n"
+"                           error is over its documented bound\n"
+"  --saturator              Measure the output saturator's aliasing and\n"
+"                           rolloff; exits 1 if out of bounds\n"
+"  --sysex                  Check the packed sysex format against its\n"
+"                           description; exits 1 if it doesn't match\n"
+"  --wavetable              Check the SIMD wavetable kernel against the\n"
+"                           scalar path and time both; exits 1 on a mismatch\n";
+
+// Untimed lead in so workers are spinning and caches are warm
+#define BENCHMARK_WARMUP_SECONDS 0.5
+
+struct BenchmarkOptions
+{
+    MemoryBlock state;
+    File midiFile;
+    bool mpe = true;
+    double seconds = 10.0;
+    Array<int> blockSizes { 32, 64, 128, 256, 512 };
+    Array<double> sampleRates { 44100.0, 48000.0, 96000.0 };
+    Array<int> voices { 1, 6, 12 };
+    int threads = 0;
+    bool offline = false;
+    File output;
+};
+
+//==============================================================================
+template <typename T>
+static bool parseList(const String& text, Array<T>& list)
+{
+    list.clear();
+    for (auto item : StringArray::fromTokens(text, ",", ""))
+    {
+        double value = item.trim().getDoubleValue();
+        if (value <= 0.0) return false;
+        list.add((T)value);
+    }
+    return list.size() > 0;
+}
+
+//==============================================================================
+static var runBenchmark(const BenchmarkOptions& options, double sampleRate, int blockSize,
+                        int numVoices)
+{
+    ESAudioProcessor processor;
+    if (options.state.getSize() > 0)
+    {
+        processor.setStateInformation(options.state.getData(), (int)options.state.getSize());
+        processor.waveTableLoader.waitUntilLoaded(10000);
+    }
+    if (!options.mpe) processor.setMPEMode(false);
+    processor.setNumVoicesActive(numVoices);
+    if (options.threads > 0) processor.setNumRenderThreads(options.threads);
+    
+    processor.setNonRealtime(options.offline);
+    processor.setPlayConfigDetails(0, 2, sampleRate, blockSize);
+    processor.prepareToPlay(sampleRate, blockSize);
+    
+    double totalSeconds = BENCHMARK_WARMUP_SECONDS + options.seconds;
+    MidiMessageSequence notes;
+    if (options.midiFile != File()) loadMidiFile(options.midiFile, totalSeconds, notes);
+    else notes = createSyntheticNotes(processor, numVoices, totalSeconds);
+    
+    RenderTimings timings = renderNotes(processor, notes, sampleRate, blockSize,
+                                        (int64)(totalSeconds * sampleRate),
+                                        (int64)(BENCHMARK_WARMUP_SECONDS * sampleRate), nullptr);
+    processor.releaseResources();
+    
+    DynamicObject::Ptr result = new DynamicObject();
+    result->setProperty("sampleRate", sampleRate);
+    result->setProperty("blockSize", blockSize);
+    result->setProperty("voices", numVoices);
+    timings.addTo(*result, sampleRate, blockSize, numVoices);
+    return var(result.get());
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    ArgumentList args (argc, argv);
+    
+    if (args.containsOption("--help|-h"))
+    {
+        std::cout << usage;
+        return 0;
+    }
+    
+    ScopedJuceInitialiser_GUI libraryInitialiser;
+    
+    if (args.containsOption("--golden"))
+    {
+        GoldenOptions golden;
+        golden.directory = args.getFileForOption("--golden");
+        golden.update = args.containsOption("--update");
+        if (args.containsOption("--tolerance"))
+        {
+            golden.tolerance = args.getValueForOption("--tolerance").getDoubleValue();
+        }
+        if (args.containsOption("--seconds"))
+        {
+            golden.seconds = args.getValueForOption("--seconds").getDoubleValue();
+        }
+        if (!golden.directory.isDirectory() || golden.seconds <= 0.0 || golden.tolerance < 0.0)
+        {
+            std::cerr << usage;
+            return 1;
+        }
+        
+        DynamicObject::Ptr report = new DynamicObject();
+        int numFailed = runGoldenRenders(golden, *report);
+        std::cout << JSON::toString(var(report.get())) << "\n";
+        return numFailed > 0 ? 1 : 0;
+    }
+    
+    if (args.containsOption("--math"))
+    {
+        DynamicObject::Ptr report = new DynamicObject();
+        int numFailed = runMathChecks(*report);
+        std::cout << JSON::toString(var(report.get())) << "\n";
+        return numFailed > 0 ? 1 : 0;
+    }
+    
+    if (args.containsOption("--saturator"))
+    {
+        DynamicObject::Ptr report = new DynamicObject();
+        int numFailed = runSaturatorChecks(*report);
+        std::cout << JSON::toString(var(report.get())) << "\n";
+        return numFailed > 0 ? 1 : 0;
+    }
+    
+    if (args.containsOption("--sysex"))
+    {
+        DynamicObject::Ptr report = new DynamicObject();
+        int numFailed = runSysexChecks(*report);
+        std::cout << JSON::toString(var(report.get())) << "\n";
+        return numFailed > 0 ? 1 : 0;
+    }
+    
+    if (args.containsOption("--wavetable"))
+    {
+        DynamicObject::Ptr report = new DynamicObject();
+        int numFailed = runWaveTableChecks(*report);
+        std::cout << JSON::toString(var(report.get())) << "\n";
+        return numFailed > 0 ? 1 : 0;
+    }
+    
+    BenchmarkOptions options;
+    
+    if (args.containsOption("--state"))
+    {
+        File file = args.getFileForOption("--state");
+        if (!loadState(file, options.state))
+        {
+            std::cerr << "Couldn't load state from " << file.getFullPathName() << "\n";
+            return 1;
+        }
+    }
+    if (args.containsOption("--midi"))
+    {
+        options.midiFile = args.getFileForOption("--midi");
+        MidiMessageSequence check;
+        if (!loadMidiFile(options.midiFile, 1.0, check))
+        {
+            std::cerr << "Couldn't load notes from " << options.midiFile.getFullPathName() << "\n";
+            return 1;
+        }
+    }
+    options.mpe = !args.containsOption("--no-mpe");
+    options.offline = args.containsOption("--offline");
+    
+    if (args.containsOption("--seconds"))
+    {
+        options.seconds = args.getValueForOption("--seconds").getDoubleValue();
+    }
+    if (args.containsOption("--threads"))
+    {
+        options.threads = jlimit(1, MAX_RENDER_THREADS,
+                                 args.getValueForOption("--threads").getIntValue());
+    }
+    
+    if ((args.containsOption("--block-sizes") &&
+         !parseList(args.getValueForOption("--block-sizes"), options.blockSizes)) ||
+        (args.containsOption("--sample-rates") &&
+         !parseList(args.getValueForOption("--sample-rates"), options.sampleRates)) ||
+        (args.containsOption("--voices") &&
+         !parseList(args.getValueForOption("--voices"), options.voices)) ||
+        options.seconds <= 0.0)
+    {
+        std::cerr << usage;
+        return 1;
+    }
+    
+    if (args.containsOption("--output"))
+    {
+        options.output = args.getFileForOption("--output");
+    }
+    
+    Array<var> results;
+    for (double sampleRate : options.sampleRates)
+    {
+        for (int blockSize : options.blockSizes)
+        {
+            for (int voices : options.voices)
+            {
+                voices = jlimit(1, NUM_STRINGS, voices);
+                std::cerr << sampleRate << " Hz, " << blockSize << " samples, "
+                << voices << " voices\n";
+                results.add(runBenchmark(options, sampleRate, blockSize, voices));
+            }
+        }
+    }
+    
+    DynamicObject::Ptr root = new DynamicObject();
+    root->setProperty("seconds", options.seconds);
+    root->setProperty("notes", options.midiFile != File() ?
+                      options.midiFile.getFullPathName() : String("synthetic"));
+    root->setProperty("mpe", options.mpe);
+    root->setProperty("offline", options.offline);
+    root->setProperty("results", results);
+    
+    String json = JSON::toString(var(root.get()));
+    if (options.output != File())
+    {
+        if (!options.output.replaceWithText(json))
+        {
+            std::cerr << "Couldn't write " << options.output.getFullPathName() << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        std::cout << json << "\n";
+    }
+    
+    return 0;
+}
@@ -0,0 +1,155 @@
+/*
+  ==============================================================================
+
+    MathCheck.cpp
+
+  ==============================================================================
+*/
+
+#include "MathCheck.h"
+#include "../../Source/FastMath.h"
+
+// Points checked across each range
+#define MATH_CHECK_POINTS 4000000
+// Points along each axis for functions of two variables
+#define MATH_CHECK_GRID 2000
+
+//==============================================================================
+struct MathCheck
+{
+    const char* name;
+    // Against |reference| instead of absolute
+    bool relative;
+    double bound;
+    double lo, hi;
+    double (*reference)(double);
+    float (*scalar)(float);
+    float4 (*vector)(float4);
+};
+
+static double error(double value, double reference, bool relative)
+{
+    double e = std::abs(value - reference);
+    return relative ? e / std::abs(reference) : e;
+}
+
+static double mtof(double m) { return 440.0 * std::pow(2.0, (m - 69.0) / 12.0); }
+static double sin2Pi(double p) { return std::sin(2.0 * M_PI * p); }
+static double exp2d(double x) { return std::exp2(x); }
+static double log2d(double x) { return std::log2(x); }
+static double tanhd(double x) { return std::tanh(x); }
+static double sind(double x) { return std::sin(x); }
+static double tand(double x) { return std::tan(x); }
+
+// The overloads need picking out before they can be passed around
+static float exp2s(float x) { return fastExp2(x); }
+static float log2s(float x) { return fastLog2(x); }
+static float mtofs(float x) { return fastMtof(x); }
+static float tanhs(float x) { return fastTanh(x); }
+static float sins(float x) { return fastSin(x); }
+static float sin2Pis(float x) { return fastSin2Pi(x); }
+static float tans(float x) { return fastTan(x); }
+static float4 exp2v(float4 x) { return fastExp2(x); }
+static float4 log2v(float4 x) { return fastLog2(x); }
+static float4 mtofv(float4 x) { return fastMtof(x); }
+static float4 tanhv(float4 x) { return fastTanh(x); }
+static float4 sinv(float4 x) { return fastSin(x); }
+static float4 sin2Piv(float4 x) { return fastSin2Pi(x); }
+static float4 tanv(float4 x) { return fastTan(x); }
+
+// Bounds as documented in FastMath.h
+static const MathCheck checks[] =
+{
+    { "fastExp2",   true,  2.5e-7, -126.0, 127.0,   exp2d,  exp2s,   exp2v },
+    { "fastLog2",   false, 1.6e-7, 0.5, 2.0,        log2d,  log2s,   log2v },
+    { "fastMtof",   true,  6.5e-7, -20.0, 140.0,    mtof,   mtofs,   mtofv },
+    { "fastTanh",   false, 1.6e-7, -20.0, 20.0,     tanhd,  tanhs,   tanhv },
+    { "fastSin",    false, 3.5e-7, -4.0, 4.0,       sind,   sins,    sinv },
+    { "fastSin",    false, 7e-6,   -100.0, 100.0,   sind,   sins,    sinv },
+    { "fastSin2Pi", false, 2.2e-7, -1000.0, 1000.0, sin2Pi, sin2Pis, sin2Piv },
+    { "fastTan",    true,  1.5e-6, 0.0, 0.45 * M_PI, tand,  tans,    tanv },
+    { "fastTan",    true,  7e-6,   0.0, 0.49 * M_PI, tand,  tans,    tanv },
+};
+static const double powBound = 2.5e-7;
+
+//==============================================================================
+static var addResult(const String& name, double lo, double hi, double bound,
+                     double scalarError, double vectorError, int& numFailed)
+{
+    bool passed = scalarError <= bound && vectorError <= bound;
+    if (!passed) numFailed++;
+    
+    std::cerr << name << " [" << lo << ", " << hi << "]: scalar " << scalarError
+    << ", float4 " << vectorError << ", bound " << bound << (passed ? ": ok\n" : ": FAILED\n");
+    
+    DynamicObject::Ptr result = new DynamicObject();
+    result->setProperty("name", name);
+    result->setProperty("lo", lo);
+    result->setProperty("hi", hi);
+    result->setProperty("bound", bound);
+    result->setProperty("scalarError", scalarError);
+    result->setProperty("vectorError", vectorError);
+    result->setProperty("passed", passed);
+    return var(result.get());
+}
+
+int runMathChecks(DynamicObject& report)
+{
+    Array<var> results;
+    int numFailed = 0;
+    
+    for (auto& check : checks)
+    {
+        double scalarError = 0.0, vectorError = 0.0;
+        float in[SIMD_WIDTH], out[SIMD_WIDTH];
+        for (int i = 0; i < MATH_CHECK_POINTS; i += SIMD_WIDTH)
+        {
+            for (int j = 0; j < SIMD_WIDTH; ++j)
+            {
+                in[j] = (float)(check.lo + (check.hi - check.lo) * (i + j) / (MATH_CHECK_POINTS - 1));
+            }
+            check.vector(float4::load(in)).store(out);
+            
+            for (int j = 0; j < SIMD_WIDTH; ++j)
+            {
+                // Against the float actually passed in, so rounding the
+                // input isn't counted
+                double reference = check.reference((double)in[j]);
+                scalarError = jmax(scalarError, error(check.scalar(in[j]), reference, check.relative));
+                vectorError = jmax(vectorError, error(out[j], reference, check.relative));
+            }
+        }
+        results.add(addResult(check.name, check.lo, check.hi, check.bound,
+                              scalarError, vectorError, numFailed));
+    }
+    
+    // fastPow over x in [0, 1], y in [1/8, 8]
+    {
+        double scalarError = 0.0, vectorError = 0.0;
+        float x[SIMD_WIDTH], y[SIMD_WIDTH], out[SIMD_WIDTH];
+        for (int i = 0; i < MATH_CHECK_GRID; ++i)
+        {
+            for (int k = 0; k < MATH_CHECK_GRID; k += SIMD_WIDTH)
+            {
+                for (int j = 0; j < SIMD_WIDTH; ++j)
+                {
+                    x[j] = (float)i / (MATH_CHECK_GRID - 1);
+                    y[j] = 0.125f + (8.f - 0.125f) * (k + j) / (MATH_CHECK_GRID - 1);
+                }
+                fastPow(float4::load(x), float4::load(y)).store(out);
+                
+                for (int j = 0; j < SIMD_WIDTH; ++j)
+                {
+                    double reference = std::pow((double)x[j], (double)y[j]);
+                    scalarError = jmax(scalarError, error(fastPow(x[j], y[j]), reference, false));
+                    vectorError = jmax(vectorError, error(out[j], reference, false));
+                }
+            }
+        }
+        results.add(addResult("fastPow", 0.0, 1.0, powBound, scalarError, vectorError, numFailed));
+    }
+    
+    report.setProperty("failed", numFailed);
+    report.setProperty("results", results);
+    return numFailed;
+}
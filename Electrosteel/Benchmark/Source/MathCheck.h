@@ -0,0 +1,22 @@
+/*
+  ==============================================================================
+
+    MathCheck.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+// Checks every FastMath.h function, scalar and float4, against double
+// precision libm over the ranges FastMath.h documents, and fails any whose
+// maximum error is over the bound given there. Those bounds are what keeps
+// the per sample paths below anything audible, so a change to the
+// approximations has to either stay inside them or update the table and
+// this check together.
+
+// Fills report and returns the number of checks that failed
+int runMathChecks(DynamicObject& report);
@@ -0,0 +1,187 @@
+/*
+  ==============================================================================
+
+    SaturatorCheck.cpp
+
+  ==============================================================================
+*/
+
+#include "SaturatorCheck.h"
+#include "../../Source/Oversampler.h"
+#include "../../Source/Utilities.h"
+
+// Analysed length; the sines are tuned to a whole number of cycles in it so
+// every harmonic lands exactly on a bin and no window is needed
+#define SATURATOR_CHECK_LENGTH 65536
+// Rendered and thrown away first so the filters have settled
+#define SATURATOR_CHECK_LEAD_IN 4096
+
+//==============================================================================
+struct SaturatorCase
+{
+    float drive;
+    double frequency;
+};
+
+static const SaturatorCase cases[] =
+{
+    { 1.f, 10000.0 },
+    { 3.f, 5000.0 },
+    { 3.f, 10000.0 },
+    { 10.f, 10000.0 },
+};
+
+// Nearest frequency with a whole number of cycles in the analysed length
+static int getBin(double frequency)
+{
+    return (int)std::round(frequency * SATURATOR_CHECK_LENGTH / SATURATOR_CHECK_SAMPLE_RATE);
+}
+
+static void makeSine(int bin, float drive, std::vector<float>& out)
+{
+    out.resize(SATURATOR_CHECK_LEAD_IN + SATURATOR_CHECK_LENGTH);
+    for (size_t s = 0; s < out.size(); ++s)
+    {
+        double phase = (double)(s % SATURATOR_CHECK_LENGTH) * bin / SATURATOR_CHECK_LENGTH;
+        out[s] = drive * (float)std::sin(2.0 * M_PI * phase);
+    }
+}
+
+// 0 for the old path, otherwise a StereoOversampler at that factor
+static void saturate(std::vector<float>& samples, int factor, bool antiderivative)
+{
+    if (factor == 0)
+    {
+        LEAF leaf;
+        char memory[1];
+        LEAF_init(&leaf, (float)SATURATOR_CHECK_SAMPLE_RATE, memory, 1, []() { return 0.f; });
+        tOversampler oversampler;
+        tOversampler_init(&oversampler, 8, 0, &leaf);
+        float array[8];
+        for (auto& sample : samples)
+        {
+            sample = tOversampler_tick(&oversampler, sample, array, &tanhf);
+        }
+        tOversampler_free(&oversampler);
+        return;
+    }
+    
+    StereoOversampler oversampler;
+    oversampler.setFactor(factor);
+    oversampler.setAntiderivative(antiderivative);
+    std::vector<float> right (RENDER_BLOCK_SIZE);
+    for (size_t s = 0; s < samples.size(); s += RENDER_BLOCK_SIZE)
+    {
+        int n = (int)jmin((size_t)RENDER_BLOCK_SIZE, samples.size() - s);
+        std::copy(samples.begin() + s, samples.begin() + s + n, right.begin());
+        oversampler.processTanh(&samples[s], right.data(), n);
+    }
+}
+
+static std::vector<double> getPowerSpectrum(const std::vector<float>& samples)
+{
+    std::vector<std::complex<double>> x (SATURATOR_CHECK_LENGTH);
+    for (int s = 0; s < SATURATOR_CHECK_LENGTH; ++s) x[s] = samples[SATURATOR_CHECK_LEAD_IN + s];
+    fft(x, false);
+    
+    std::vector<double> power (SATURATOR_CHECK_LENGTH / 2);
+    for (size_t k = 0; k < power.size(); ++k) power[k] = std::norm(x[k]);
+    return power;
+}
+
+// Energy below the top frequency that isn't DC or a harmonic, relative to
+// the whole output, in dB
+static double measureAliasing(int bin, float drive, int factor, bool antiderivative)
+{
+    std::vector<float> samples;
+    makeSine(bin, drive, samples);
+    saturate(samples, factor, antiderivative);
+    std::vector<double> power = getPowerSpectrum(samples);
+    
+    int topBin = getBin(SATURATOR_CHECK_MAX_FREQ);
+    double total = 0.0, aliased = 0.0;
+    for (int k = 1; k < (int)power.size(); ++k)
+    {
+        total += power[k];
+        if (k <= topBin && k % bin != 0) aliased += power[k];
+    }
+    return 10.0 * std::log10(jmax(aliased, 1e-30) / total);
+}
+
+// Gain at a bin for a sine small enough that tanh is linear, in dB
+static double measureGain(int bin, int factor, bool antiderivative)
+{
+    const float level = 0.001f;
+    std::vector<float> samples;
+    makeSine(bin, level, samples);
+    saturate(samples, factor, antiderivative);
+    std::vector<double> power = getPowerSpectrum(samples);
+    
+    double amplitude = 2.0 * std::sqrt(power[bin]) / SATURATOR_CHECK_LENGTH;
+    return 20.0 * std::log10(amplitude / level);
+}
+
+//==============================================================================
+int runSaturatorChecks(DynamicObject& report)
+{
+    Array<var> results;
+    int numFailed = 0;
+    
+    for (auto& c : cases)
+    {
+        int bin = getBin(c.frequency);
+        DynamicObject::Ptr result = new DynamicObject();
+        result->setProperty("drive", c.drive);
+        result->setProperty("frequency", bin * SATURATOR_CHECK_SAMPLE_RATE / SATURATOR_CHECK_LENGTH);
+        
+        double old = measureAliasing(bin, c.drive, 0, false);
+        result->setProperty("tOversampler8x", old);
+        std::cerr << "drive " << c.drive << ", " << c.frequency << "Hz: tOversampler 8x " << old << "dB";
+        
+        bool passed = true;
+        for (int factor = 1; factor <= 8; factor *= 2)
+        {
+            double plain = measureAliasing(bin, c.drive, factor, false);
+            double adaa = measureAliasing(bin, c.drive, factor, true);
+            result->setProperty(String(factor) + "x", plain);
+            result->setProperty(String(factor) + "xAntiderivative", adaa);
+            std::cerr << ", " << factor << "x " << plain << "/" << adaa << "dB";
+            
+            passed = passed && adaa <= jmax(plain, SATURATOR_CHECK_FLOOR_DB);
+            if (factor == 4) passed = passed && adaa <= old + SATURATOR_CHECK_MARGIN_DB;
+        }
+        std::cerr << (passed ? ": ok\n" : ": FAILED\n");
+        
+        result->setProperty("passed", passed);
+        if (!passed) numFailed++;
+        results.add(var(result.get()));
+    }
+    
+    // A first order antiderivative is a two tap average at the oversampled
+    // rate, so its response is cos(pi f / (factor * fs))
+    int bin = getBin(20000.0);
+    double frequency = bin * SATURATOR_CHECK_SAMPLE_RATE / SATURATOR_CHECK_LENGTH;
+    for (int factor = 1; factor <= 8; factor *= 2)
+    {
+        double rolloff = measureGain(bin, factor, true) - measureGain(bin, factor, false);
+        double expected = 20.0 * std::log10(std::cos(M_PI * frequency /
+                                                      (factor * SATURATOR_CHECK_SAMPLE_RATE)));
+        bool passed = std::abs(rolloff - expected) <= SATURATOR_CHECK_ROLLOFF_TOLERANCE_DB;
+        std::cerr << "rolloff at " << frequency << "Hz, " << factor << "x: " << rolloff
+        << "dB, expected " << expected << "dB" << (passed ? ": ok\n" : ": FAILED\n");
+        
+        DynamicObject::Ptr result = new DynamicObject();
+        result->setProperty("factor", factor);
+        result->setProperty("frequency", frequency);
+        result->setProperty("rolloff", rolloff);
+        result->setProperty("expected", expected);
+        result->setProperty("passed", passed);
+        if (!passed) numFailed++;
+        results.add(var(result.get()));
+    }
+    
+    report.setProperty("sampleRate", SATURATOR_CHECK_SAMPLE_RATE);
+    report.setProperty("failed", numFailed);
+    report.setProperty("results", results);
+    return numFailed;
+}
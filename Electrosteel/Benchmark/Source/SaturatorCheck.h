@@ -0,0 +1,39 @@
+/*
+  ==============================================================================
+
+    SaturatorCheck.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#define SATURATOR_CHECK_SAMPLE_RATE 48000.0
+// Aliasing is counted up to here, roughly the top of hearing
+#define SATURATOR_CHECK_MAX_FREQ 19000.0
+// Aliasing below this is rounding noise, which antiderivative antialiasing
+// adds a little of, and isn't compared
+#define SATURATOR_CHECK_FLOOR_DB -100.0
+// How much more aliasing 4x with antiderivative antialiasing may have than
+// the tOversampler path at 8x that it replaces
+#define SATURATOR_CHECK_MARGIN_DB 6.0
+// How far the measured rolloff may be from the figure in Oversampler.h
+#define SATURATOR_CHECK_ROLLOFF_TOLERANCE_DB 0.1
+
+//==============================================================================
+// Measures the output saturator's aliasing on driven sines. StereoOversampler
+// at every factor, with and without antiderivative antialiasing, is compared
+// with the LEAF tOversampler and tanhf path the output stage used before.
+// Aliasing is the energy below SATURATOR_CHECK_MAX_FREQ that isn't at a
+// harmonic of the sine, relative to the whole output. Fails if
+//   - antiderivative antialiasing ever aliases audibly more than plain tanh
+//     at the same factor
+//   - 4x with it aliases more than SATURATOR_CHECK_MARGIN_DB over the old 8x
+//     path
+//   - its high end rolloff, measured on a quiet 20kHz sine, isn't the
+//     cos(pi f / oversampled rate) documented in Oversampler.h
+
+// Fills report and returns the number of checks that failed
+int runSaturatorChecks(DynamicObject& report);
@@ -0,0 +1,255 @@
+/*
+  ==============================================================================
+  
+    SysexCheck.cpp
+  
+  ==============================================================================
+*/
+
+#include "SysexCheck.h"
+#include "../../Source/SysexSender.h"
+
+// Longest a send through SysexSender may take before it counts as stuck
+#define SYSEX_CHECK_TIMEOUT_MS 10000
+// Rounding in the quantiser's float maths, in steps, on top of the half step
+#define SYSEX_CHECK_ROUNDING_STEPS 0.01
+
+//==============================================================================
+// Groups of a byte of top bits, first byte's in bit 0, then up to 7 bytes
+static void decode7to8(const uint8* in, int size, std::vector<uint8>& out)
+{
+    for (int i = 0; i < size; i += 8)
+    {
+        uint8 topBits = in[i];
+        for (int j = 1; j < 8 && i + j < size; ++j)
+        {
+            out.push_back((uint8)(in[i+j] | (((topBits >> (j - 1)) & 1) << 7)));
+        }
+    }
+}
+
+// Checks one payload, from the ID to the checksum, as packet index of a
+// transfer, and appends its decoded chunk. Returns an empty string if it's
+// well formed
+static String checkPacket(const uint8* payload, int size, uint8 type, int index, bool last,
+                          std::vector<uint8>& decoded)
+{
+    if (size < 7 || size > SYSEX_PACKED_MAX_PAYLOAD) return "size " + String(size);
+    for (int i = 0; i < size; ++i)
+    {
+        if (payload[i] > 127) return "8 bit byte at " + String(i);
+    }
+    if (payload[0] != SYSEX_PACKED_ID || payload[1] != SYSEX_PACKED_VERSION) return "header";
+    if (payload[2] != type) return "type " + String(payload[2]);
+    int sequence = (payload[3] << 7) | payload[4];
+    if (sequence != (index & 16383)) return "sequence " + String(sequence);
+    if (payload[5] != (last ? 1 : 0)) return "flags " + String(payload[5]);
+    
+    int sum = 0;
+    for (int i = 1; i < size; ++i) sum += payload[i];
+    if ((sum & 127) != 0) return "checksum";
+    
+    decode7to8(payload + 6, size - 7, decoded);
+    return {};
+}
+
+static bool addResult(Array<var>& results, DynamicObject::Ptr result, const String& name,
+                      const String& error)
+{
+    bool passed = error.isEmpty();
+    std::cerr << name << (passed ? String(": ok\n") : ": FAILED, " + error + "\n");
+    
+    result->setProperty("name", name);
+    if (!passed) result->setProperty("error", error);
+    result->setProperty("passed", passed);
+    results.add(var(result.get()));
+    return passed;
+}
+
+//==============================================================================
+static String checkTransfer(size_t size, DynamicObject& result)
+{
+    // Every byte value, top bit included
+    Random random (int64(size) + 1);
+    std::vector<uint8> data (size);
+    for (auto& byte : data) byte = (uint8)random.nextInt(256);
+    
+    int numPackets = SysexSender::getNumTransferPackets(size);
+    int expected = jmax(1, (int)((size + SYSEX_PACKED_CHUNK_SIZE - 1) / SYSEX_PACKED_CHUNK_SIZE));
+    result.setProperty("packets", numPackets);
+    if (numPackets != expected) return "expected " + String(expected) + " packets";
+    
+    std::vector<uint8> decoded;
+    uint8 payload[SYSEX_PACKED_MAX_PAYLOAD];
+    for (int i = 0; i < numPackets; ++i)
+    {
+        int length = SysexSender::getTransferPacket(2, data.data(), size, i, payload);
+        String error = checkPacket(payload, length, 2, i, i == numPackets - 1, decoded);
+        if (error.isNotEmpty()) return "packet " + String(i) + ": " + error;
+    }
+    if (decoded != data) return "decoded bytes differ";
+    return {};
+}
+
+//==============================================================================
+static WaveTableData::Ptr makeData()
+{
+    // A saw and a square, whose band-limited levels overshoot 1
+    Array<AudioBuffer<float>> frames;
+    for (int f = 0; f < 2; ++f)
+    {
+        AudioBuffer<float> frame (1, WAVETABLE_FRAME_SIZE);
+        for (int i = 0; i < WAVETABLE_FRAME_SIZE; ++i)
+        {
+            float x = (float)i / WAVETABLE_FRAME_SIZE;
+            frame.setSample(0, i, f == 0 ? 2.f * x - 1.f : (x < 0.5f ? 1.f : -1.f));
+        }
+        frames.add(frame);
+    }
+    return new WaveTableData(frames);
+}
+
+// Sends a delta with one set and takes the packets out as the audio thread
+// would, as transfers of decoded bytes in the order they went out
+static String sendDelta(SysexSender& sender, const MemoryBlock& records,
+                        const WaveTableData::Ptr& data, Array<MemoryBlock>& transfers,
+                        Array<int>& types)
+{
+    sender.sendDelta(1234, records, { data });
+    
+    std::vector<uint8> decoded;
+    int index = 0;
+    uint32 start = Time::getMillisecondCounter();
+    while (sender.isSending())
+    {
+        if (Time::getMillisecondCounter() - start > SYSEX_CHECK_TIMEOUT_MS) return "timed out";
+        
+        MidiBuffer midi;
+        sender.renderNextBlock(midi, 512);
+        if (midi.isEmpty()) Thread::sleep(1);
+        
+        for (MidiMessageMetadata metadata : midi)
+        {
+            const uint8* packet = metadata.data;
+            int size = metadata.numBytes;
+            if (size < 2 || packet[0] != 0xf0 || packet[size-1] != 0xf7) return "framing";
+            
+            // The type of the first packet of a transfer is what the rest
+            // of it must have
+            if (index == 0) types.add(size > 3 ? packet[3] : -1);
+            bool last = size > 6 && packet[6] == 1;
+            String error = checkPacket(packet + 1, size - 2, (uint8)types.getLast(), index,
+                                       last, decoded);
+            if (error.isNotEmpty()) return "transfer " + String(types.size() - 1) + ", packet " +
+                String(index) + ": " + error;
+            
+            index++;
+            if (last)
+            {
+                transfers.add(MemoryBlock(decoded.data(), decoded.size()));
+                decoded.clear();
+                index = 0;
+            }
+        }
+    }
+    if (index != 0) return "unfinished transfer";
+    return {};
+}
+
+// Checks a wavetable transfer against the set it was sent from. maxSteps is
+// the largest int16 error, in quantisation steps
+static String checkWaveTables(const MemoryBlock& transfer, const WaveTableData& data,
+                              bool quantise, double& maxSteps)
+{
+    MemoryInputStream stream (transfer, false);
+    if (stream.readShort() != data.getNumFrames() || stream.readByte() != WAVETABLE_NUM_LEVELS ||
+        stream.readByte() != (quantise ? 1 : 0)) return "set header";
+    
+    maxSteps = 0.0;
+    for (int f = 0; f < data.getNumFrames(); ++f)
+    {
+        for (int l = 0; l < WAVETABLE_NUM_LEVELS; ++l)
+        {
+            int size = WaveTableData::getLevelSize(l);
+            if (stream.readShort() != size) return "level size";
+            
+            const float* level = data.getLevel(f, l);
+            double step = quantise ? stream.readFloat() / 32767.0 : 0.0;
+            for (int i = 0; i < size; ++i)
+            {
+                if (!quantise)
+                {
+                    if (stream.readFloat() != level[i]) return "float32 sample differs";
+                    continue;
+                }
+                double sample = stream.readShort() * step;
+                maxSteps = jmax(maxSteps, std::abs(sample - level[i]) / step);
+            }
+        }
+    }
+    if (stream.getNumBytesRemaining() != 0) return "bytes left over";
+    if (maxSteps > 0.5 + SYSEX_CHECK_ROUNDING_STEPS) return "off by " + String(maxSteps) + " steps";
+    return {};
+}
+
+//==============================================================================
+int runSysexChecks(DynamicObject& report)
+{
+    Array<var> results;
+    int numFailed = 0;
+    
+    const size_t sizes[] = { 0, 1, SYSEX_PACKED_CHUNK_SIZE, SYSEX_PACKED_CHUNK_SIZE + 1, 100000 };
+    for (auto size : sizes)
+    {
+        DynamicObject::Ptr result = new DynamicObject();
+        result->setProperty("bytes", (int)size);
+        String error = checkTransfer(size, *result);
+        if (!addResult(results, result, "transfer of " + String((int)size) + " bytes", error)) numFailed++;
+    }
+    
+    WaveTableData::Ptr data = makeData();
+    MemoryOutputStream records;
+    records.writeByte(0);
+    records.writeShort(5);
+    records.writeFloat(0.25f);
+    records.writeByte(3);
+    records.writeByte(0);
+    records.writeByte(1);
+    
+    SysexSender sender;
+    sender.setFormat(PackedSysexFormat);
+    // As fast as the FIFO can be emptied
+    sender.setBytesPerSecond(1 << 30);
+    sender.prepareToPlay(48000.0);
+    
+    for (bool quantise : { true, false })
+    {
+        sender.setQuantiseWaveTables(quantise);
+        DynamicObject::Ptr result = new DynamicObject();
+        Array<MemoryBlock> transfers;
+        Array<int> types;
+        
+        String error = sendDelta(sender, records.getMemoryBlock(), data, transfers, types);
+        if (error.isEmpty() && (types != Array<int>({ 3, 2 }) || transfers.size() != 2))
+        {
+            error = "expected a delta then a wavetable transfer";
+        }
+        if (error.isEmpty())
+        {
+            MemoryOutputStream delta;
+            delta.writeShort(1234);
+            delta.write(records.getData(), records.getDataSize());
+            if (transfers[0] != delta.getMemoryBlock()) error = "delta differs";
+        }
+        double maxSteps = 0.0;
+        if (error.isEmpty()) error = checkWaveTables(transfers[1], *data, quantise, maxSteps);
+        
+        if (quantise) result->setProperty("maxErrorSteps", maxSteps);
+        if (!addResult(results, result, quantise ? "delta with an int16 set" :
+                       "delta with a float32 set", error)) numFailed++;
+    }
+    
+    report.setProperty("failed", numFailed);
+    report.setProperty("results", results);
+    return numFailed;
+}
@@ -0,0 +1,28 @@
+/*
+  ==============================================================================
+  
+    SysexCheck.h
+  
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+// Checks the packed sysex format against its description in SysexSender.h,
+// with a decoder written from that description rather than from the sender.
+// Fails if
+//   - a transfer of 0, 1, one chunk, one chunk and a byte, or 100000 bytes
+//     isn't split into the expected packets, each with the ID, version,
+//     type, sequence number, last flag and a zero 7 bit sum, and only 7 bit
+//     bytes, or doesn't decode back to the bytes sent
+//   - a delta with a wavetable set, sent through SysexSender and its FIFO
+//     as the audio thread would take it, isn't two such transfers in order
+//     that decode to the delta and the set
+//   - an int16 sample of that set is more than half a step from the level
+//     it was quantised from, or a float32 sample isn't exact
+
+// Fills report and returns the number of checks that failed
+int runSysexChecks(DynamicObject& report);
@@ -0,0 +1,248 @@
+/*
+  ==============================================================================
+  
+    WaveTableCheck.cpp
+  
+  ==============================================================================
+*/
+
+#include "WaveTableCheck.h"
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/Oscillators.h"
+#include "../../Source/WaveTables.h"
+#include "../../Source/FastMath.h"
+
+// Blocks rendered by each of the checked cases
+#define WAVETABLE_CHECK_BLOCKS 200
+// Blocks rendered by each path when timing
+#define WAVETABLE_CHECK_TIMED_BLOCKS 20000
+
+//==============================================================================
+// Frames with a different mix of harmonics each, so that every frame and
+// level a lane reads makes a difference to its output
+static WaveTableData::Ptr makeData(int numFrames)
+{
+    Array<AudioBuffer<float>> frames;
+    for (int f = 0; f < numFrames; ++f)
+    {
+        AudioBuffer<float> frame (1, WAVETABLE_FRAME_SIZE);
+        float* samples = frame.getWritePointer(0);
+        for (int i = 0; i < WAVETABLE_FRAME_SIZE; ++i)
+        {
+            double x = (double)i / WAVETABLE_FRAME_SIZE;
+            double sum = 0.0;
+            for (int h = 1; h <= 256; ++h)
+            {
+                sum += std::sin(2.0 * M_PI * h * x + f * h) / (h + f);
+            }
+            samples[i] = (float)(0.5 * sum);
+        }
+        frames.add(frame);
+    }
+    return new WaveTableData(frames);
+}
+
+// The same frame and level picks as WaveTableBank, every sample, with each
+// table read on its own
+struct ScalarPath
+{
+    float phase[NUM_STRINGS] = {};
+    float invSampleRate = 1.f / (float)WAVETABLE_CHECK_SAMPLE_RATE;
+    float invCutoff = 1.f / jmin(WAVETABLE_MAX_FREQ, 0.45f * (float)WAVETABLE_CHECK_SAMPLE_RATE);
+    
+    void tick(const WaveTableData& data, float output[][NUM_STRINGS],
+              const float freq[][NUM_STRINGS], const float shape[][NUM_STRINGS], int numSamples)
+    {
+        const int lastFrame = data.getNumFrames() - 1;
+        for (int v = 0; v < NUM_STRINGS; ++v)
+        {
+            for (int s = 0; s < numSamples; ++s)
+            {
+                float p = phase[v] + freq[s][v] * invSampleRate;
+                p = p - std::floor(p);
+                if (p >= 1.f) p = 0.f;
+                phase[v] = p;
+                
+                float top = fabsf(freq[s][v]) * (WAVETABLE_FRAME_SIZE / 2) * invCutoff;
+                float level = top > 0.5f ? fastLog2(top) + 1.f : 0.f;
+                level = LEAF_clip(0.f, level, WAVETABLE_NUM_LEVELS - 1.f);
+                int l0 = (int)level;
+                int l1 = jmin(l0 + 1, WAVETABLE_NUM_LEVELS - 1);
+                float levelMix = level - l0;
+                
+                float frame = LEAF_clip(0.f, shape[s][v], 1.f) * lastFrame;
+                int f0 = (int)frame;
+                int f1 = jmin(f0 + 1, lastFrame);
+                float frameMix = frame - f0;
+                
+                float lower = data.read(f0, l0, p) + (data.read(f0, l1, p) - data.read(f0, l0, p)) * levelMix;
+                float upper = data.read(f1, l0, p) + (data.read(f1, l1, p) - data.read(f1, l0, p)) * levelMix;
+                output[s][v] = lower + (upper - lower) * frameMix;
+            }
+        }
+    }
+};
+
+struct WaveTableRun
+{
+    WaveTableRun(ESAudioProcessor& processor) : bank(processor)
+    {
+        bank.setSampleRate(WAVETABLE_CHECK_SAMPLE_RATE);
+    }
+    
+    // Largest difference between the paths over one block
+    float tick(const WaveTableData& data, int numSamples)
+    {
+        const uint32_t allVoices = (1u << NUM_STRINGS) - 1u;
+        bank.tick(data, bankOutput, freq, shape, allVoices, numSamples);
+        scalar.tick(data, scalarOutput, freq, shape, numSamples);
+        
+        float error = 0.f;
+        for (int s = 0; s < numSamples; ++s)
+        {
+            for (int v = 0; v < NUM_STRINGS; ++v)
+            {
+                float e = std::abs(bankOutput[s][v] - scalarOutput[s][v]);
+                // A NaN fails too
+                error = e <= error ? error : e;
+            }
+        }
+        return error;
+    }
+    
+    WaveTableBank bank;
+    ScalarPath scalar;
+    alignas(16) float freq[RENDER_BLOCK_SIZE][NUM_STRINGS];
+    alignas(16) float shape[RENDER_BLOCK_SIZE][NUM_STRINGS];
+    alignas(16) float bankOutput[RENDER_BLOCK_SIZE][NUM_STRINGS];
+    alignas(16) float scalarOutput[RENDER_BLOCK_SIZE][NUM_STRINGS];
+};
+
+// Each string sweeps from 20Hz to 16kHz and back, across every level, while
+// its shape sweeps across every frame at its own rate
+static void fillSweep(WaveTableRun& run, int block)
+{
+    const int length = WAVETABLE_CHECK_BLOCKS * RENDER_BLOCK_SIZE;
+    for (int s = 0; s < RENDER_BLOCK_SIZE; ++s)
+    {
+        for (int v = 0; v < NUM_STRINGS; ++v)
+        {
+            double t = (double)(block * RENDER_BLOCK_SIZE + s) / length;
+            double sweep = 1.0 - std::abs(2.0 * std::fmod(t + (double)v / NUM_STRINGS, 1.0) - 1.0);
+            run.freq[s][v] = (float)(20.0 * std::pow(800.0, sweep));
+            run.shape[s][v] = (float)(0.5 - 0.5 * std::cos(2.0 * M_PI * t * (v + 1)));
+        }
+    }
+}
+
+static void fillHeld(WaveTableRun& run, float shape)
+{
+    for (int s = 0; s < RENDER_BLOCK_SIZE; ++s)
+    {
+        for (int v = 0; v < NUM_STRINGS; ++v)
+        {
+            run.freq[s][v] = 55.f * (v + 1);
+            run.shape[s][v] = shape;
+        }
+    }
+}
+
+static bool addResult(Array<var>& results, const char* name, float error)
+{
+    bool passed = error <= WAVETABLE_CHECK_TOLERANCE;
+    std::cerr << name << ": " << error << (passed ? ": ok\n" : ": FAILED\n");
+    
+    DynamicObject::Ptr result = new DynamicObject();
+    result->setProperty("name", name);
+    result->setProperty("maxError", error);
+    result->setProperty("passed", passed);
+    results.add(var(result.get()));
+    return passed;
+}
+
+//==============================================================================
+int runWaveTableChecks(DynamicObject& report)
+{
+    Array<var> results;
+    int numFailed = 0;
+    
+    WaveTableData::Ptr data = makeData(5);
+    WaveTableData::Ptr fewer = makeData(2);
+    ESAudioProcessor processor;
+    
+    {
+        processor.setControlRateInterval(1);
+        auto run = std::make_unique<WaveTableRun>(processor);
+        float error = 0.f;
+        for (int b = 0; b < WAVETABLE_CHECK_BLOCKS; ++b)
+        {
+            fillSweep(*run, b);
+            error = jmax(error, run->tick(*data, RENDER_BLOCK_SIZE));
+        }
+        if (!addResult(results, "sweep, picked every sample", error)) numFailed++;
+        processor.setControlRateInterval(DEFAULT_CONTROL_RATE_INTERVAL);
+    }
+    
+    {
+        auto run = std::make_unique<WaveTableRun>(processor);
+        fillHeld(*run, 0.4f);
+        float error = 0.f;
+        for (int b = 0; b < WAVETABLE_CHECK_BLOCKS; ++b)
+        {
+            error = jmax(error, run->tick(*data, RENDER_BLOCK_SIZE));
+        }
+        if (!addResult(results, "held, default control rate", error)) numFailed++;
+    }
+    
+    // Picks from the last frame of the first set. The fewer frames of the
+    // second are what a stale pick would read past the end of.
+    for (bool forget : { true, false })
+    {
+        auto run = std::make_unique<WaveTableRun>(processor);
+        fillHeld(*run, 1.f);
+        run->tick(*data, RENDER_BLOCK_SIZE);
+        if (forget) run->bank.forgetPicks();
+        float error = 0.f;
+        for (int b = 0; b < WAVETABLE_CHECK_BLOCKS; ++b)
+        {
+            error = jmax(error, run->tick(*fewer, RENDER_BLOCK_SIZE));
+        }
+        if (!addResult(results, forget ? "fewer frames, picks forgotten" :
+                       "fewer frames, stale picks", error)) numFailed++;
+    }
+    
+    // Timed on the sweep, every string sounding
+    {
+        auto run = std::make_unique<WaveTableRun>(processor);
+        fillSweep(*run, 0);
+        const uint32_t allVoices = (1u << NUM_STRINGS) - 1u;
+        const double perStringSample = 1e9 / ((double)WAVETABLE_CHECK_TIMED_BLOCKS *
+                                              RENDER_BLOCK_SIZE * NUM_STRINGS);
+        
+        double start = Time::getMillisecondCounterHiRes();
+        for (int b = 0; b < WAVETABLE_CHECK_TIMED_BLOCKS; ++b)
+        {
+            run->bank.tick(*data, run->bankOutput, run->freq, run->shape, allVoices, RENDER_BLOCK_SIZE);
+        }
+        double bankNs = (Time::getMillisecondCounterHiRes() - start) * 1e-3 * perStringSample;
+        
+        start = Time::getMillisecondCounterHiRes();
+        for (int b = 0; b < WAVETABLE_CHECK_TIMED_BLOCKS; ++b)
+        {
+            run->scalar.tick(*data, run->scalarOutput, run->freq, run->shape, RENDER_BLOCK_SIZE);
+        }
+        double scalarNs = (Time::getMillisecondCounterHiRes() - start) * 1e-3 * perStringSample;
+        
+        std::cerr << "bank " << bankNs << "ns, scalar " << scalarNs << "ns per string sample\n";
+        report.setProperty("bankNsPerStringSample", bankNs);
+        report.setProperty("scalarNsPerStringSample", scalarNs);
+        // Keeps the outputs live
+        report.setProperty("lastSample", run->bankOutput[0][0] + run->scalarOutput[0][0]);
+    }
+    
+    report.setProperty("sampleRate", WAVETABLE_CHECK_SAMPLE_RATE);
+    report.setProperty("tolerance", WAVETABLE_CHECK_TOLERANCE);
+    report.setProperty("failed", numFailed);
+    report.setProperty("results", results);
+    return numFailed;
+}
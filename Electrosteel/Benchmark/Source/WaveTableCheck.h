@@ -0,0 +1,31 @@
+/*
+  ==============================================================================
+  
+    WaveTableCheck.h
+  
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#define WAVETABLE_CHECK_SAMPLE_RATE 48000.0
+// Largest sample difference allowed from the scalar path
+#define WAVETABLE_CHECK_TOLERANCE 1e-5
+
+//==============================================================================
+// Checks WaveTableBank, the SIMD kernel user shape sets play through,
+// against a scalar path that reads every string's four tables one sample at
+// a time with WaveTableData::read. Fails if any sample differs by more than
+// WAVETABLE_CHECK_TOLERANCE when
+//   - frequency and shape sweep every sample, with frames and levels
+//     re-picked every sample
+//   - they are held, at the default control rate
+//   - the bank moves to a set with fewer frames, with and without being told
+//     to forget its picks into the last one
+// Also times both paths on every string, in ns per string per sample. The
+// timings are reported, not checked.
+
+// Fills report and returns the number of checks that failed
+int runWaveTableChecks(DynamicObject& report);
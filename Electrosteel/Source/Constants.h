@@ -33,6 +33,36 @@
 
 #define MAX_NUM_UNIQUE_SKEWS 10
 
+// Components render in chunks of at most this many samples; host buffers
+// larger than this are split up in processBlock
+#define RENDER_BLOCK_SIZE 64
+
+// Default number of samples between evaluations of modulation hook sums. Must
+// be a power of two no larger than RENDER_BLOCK_SIZE; 1 evaluates every sample
+#define DEFAULT_CONTROL_RATE_INTERVAL 16
+
+// A released voice whose output stays below this level (about -80dB) for
+// VOICE_SILENCE_TIMEOUT_MS is retired so it stops costing anything
+#define VOICE_SILENCE_THRESHOLD 0.0001f
+#define VOICE_SILENCE_TIMEOUT_MS 50
+// Once no voices are left and the output is below this level (about -100dB)
+// the whole engine idles until the next note
+#define ENGINE_IDLE_THRESHOLD 0.00001f
+
+// Strings are shared out between render threads a group of SIMD_WIDTH at a
+// time, so more threads than groups would have nothing to do. Chunks shorter
+// than MIN_THREADED_RENDER_SAMPLES aren't worth the cost of handing off
+#define MAX_RENDER_THREADS (NUM_STRINGS / SIMD_WIDTH)
+#define MIN_THREADED_RENDER_SAMPLES 16
+// How many times an idle render thread checks for work before sleeping;
+// roughly a millisecond
+#define RENDER_THREAD_SPINS 20000
+
+// Seeds for the per string random generators. Offline renders restart from
+// RANDOM_OFFLINE_SEED by default so bouncing the same part twice matches
+#define RANDOM_DEFAULT_SEED 0x2545f491u
+#define RANDOM_OFFLINE_SEED 0x9e3779b9u
+
 #define INV_127 0.007874015748031f
 #define INV_4095 0.0002442002442f
 #define INV_16383 0.000061038881768f;
@@ -15,11 +15,12 @@
 Envelope::Envelope(const String& n, ESAudioProcessor& p,
                    AudioProcessorValueTreeState& vts) :
 AudioComponent(n, p, vts, cEnvelopeParams, false),
-MappingSourceModel(p, n, true, false, Colours::deepskyblue)
+MappingSourceModel(p, n, true, true, false, Colours::deepskyblue)
 {
     for (int i = 0; i < processor.numInvParameterSkews; ++i)
     {
-        sourceValues[i] = (float*) leaf_alloc(&processor.leaf, sizeof(float) * NUM_STRINGS);
+        sourceValues[i] = (float*) leaf_alloc(&processor.leaf, sizeof(float) * NUM_STRINGS *
+                                              RENDER_BLOCK_SIZE);
         sources[i] = &sourceValues[i];
     }
     
@@ -74,63 +75,50 @@ void Envelope::frame()
     enabled = processor.sourceMappingCounts[getName()] > 0;
 }
 
-void Envelope::tick()
+void Envelope::tick(int numSamples, uint32_t voices)
 {
     if (!enabled) return;
-//    float a = sampleInBlock * invBlockSize;
     
-    for (int v = 0; v < processor.numVoicesActive; v++)
+    for (uint32_t m = voices; m; m &= m - 1)
     {
-        float attack = quickParams[EnvelopeAttack][v]->tickNoSmoothing();
-        float decay = quickParams[EnvelopeDecay][v]->tickNoSmoothing();
-        float sustain = quickParams[EnvelopeSustain][v]->tickNoSmoothing();
-        float release = quickParams[EnvelopeRelease][v]->tickNoSmoothing();
-        float leak = quickParams[EnvelopeLeak][v]->tickNoSmoothing();
-        attack = attack < 0.f ? 0.f : attack;
-        decay = decay < 0.f ? 0.f : decay;
-        sustain = sustain < 0.f ? 0.f : sustain;
-        release = release < 0.f ? 0.f : release;
-        leak = leak < 0.f ? 0.f : leak;
+        int v = lowestVoice(m);
         
-//        tADSRT_setAttack(&envs[v], expBuffer[(int)(attack * expBufferSizeMinusOne)] * 8192.0f);
-//        tADSRT_setDecay(&envs[v], expBuffer[(int)(decay * expBufferSizeMinusOne)] * 8192.0f);
-//        tADSRT_setSustain(&envs[v], sustain);
-//        tADSRT_setRelease(&envs[v], expBuffer[(int)(release * expBufferSizeMinusOne)] * 8192.0f);
-        tADSRT_setAttack(&envs[v], attack);
-        tADSRT_setDecay(&envs[v], decay);
-        tADSRT_setSustain(&envs[v], sustain);
-        tADSRT_setRelease(&envs[v], release);
-        tADSRT_setLeakFactor(&envs[v], 0.99995f + 0.00005f*(1.f-leak));
-
-        float value = tADSRT_tickNoInterp(&envs[v]);
-        
-        sourceValues[0][v] = value;
-        for (int i = 1; i < processor.numInvParameterSkews; ++i)
-        {
-            float invSkew = processor.quickInvParameterSkews[i];
-            sourceValues[i][v] = powf(value, invSkew);
-        }
-        
-        if (processor.strings[0]->numVoices > 1)
+        for (int s = 0; s < numSamples; ++s)
         {
-            if (processor.strings[0]->voices[v][0] == -2)
-            {
-                if (envs[v]->whichStage == env_idle)
-                {
-                    tSimplePoly_deactivateVoice(&processor.strings[0], v);
-                    processor.voiceIsSounding[v] = false;
-                }
-            }
+            float attack = quickParams[EnvelopeAttack][v]->tickNoSmoothing(s);
+            float decay = quickParams[EnvelopeDecay][v]->tickNoSmoothing(s);
+            float sustain = quickParams[EnvelopeSustain][v]->tickNoSmoothing(s);
+            float release = quickParams[EnvelopeRelease][v]->tickNoSmoothing(s);
+            float leak = quickParams[EnvelopeLeak][v]->tickNoSmoothing(s);
+            attack = attack < 0.f ? 0.f : attack;
+            decay = decay < 0.f ? 0.f : decay;
+            sustain = sustain < 0.f ? 0.f : sustain;
+            release = release < 0.f ? 0.f : release;
+            leak = leak < 0.f ? 0.f : leak;
+            
+//            tADSRT_setAttack(&envs[v], expBuffer[(int)(attack * expBufferSizeMinusOne)] * 8192.0f);
+//            tADSRT_setDecay(&envs[v], expBuffer[(int)(decay * expBufferSizeMinusOne)] * 8192.0f);
+//            tADSRT_setSustain(&envs[v], sustain);
+//            tADSRT_setRelease(&envs[v], expBuffer[(int)(release * expBufferSizeMinusOne)] * 8192.0f);
+            tADSRT_setAttack(&envs[v], attack);
+            tADSRT_setDecay(&envs[v], decay);
+            tADSRT_setSustain(&envs[v], sustain);
+            tADSRT_setRelease(&envs[v], release);
+            tADSRT_setLeakFactor(&envs[v], 0.99995f + 0.00005f*(1.f-leak));
+            
+            float value = tADSRT_tickNoInterp(&envs[v]);
+            
+            sourceValues[0][s*NUM_STRINGS + v] = value;
         }
     }
-//    sampleInBlock++;
+    
+    fillSkews(numSamples, voices);
 }
 
 void Envelope::noteOn(int voice, float velocity)
 {
     if (useVelocity->getValue() == 0) velocity = 1.f;
     tADSRT_on(&envs[voice], velocity);
-    processor.voiceIsSounding[voice] = true;
 }
 
 void Envelope::noteOff(int voice, float velocity)
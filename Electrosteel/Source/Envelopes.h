@@ -26,12 +26,15 @@ public:
     //==============================================================================
     void prepareToPlay (double sampleRate, int samplesPerBlock);
     void frame();
-    void tick();
+    void tick(int numSamples, uint32_t voices);
     
     //==============================================================================
     void noteOn(int voice, float velocity);
     void noteOff(int voice, float velocity);
     
+    bool isInUse() { return enabled; }
+    bool isIdle(int voice) { return envs[voice]->whichStage == env_idle; }
+    
 private:
     RangedAudioParameter* useVelocity;
     
@@ -0,0 +1,223 @@
+/*
+  ==============================================================================
+
+    FastMath.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "SIMD.h"
+
+//==============================================================================
+// Bounded error replacements for the libm calls on the per sample paths, each
+// with a scalar and a float4 version that compute the same thing. Maximum
+// errors against double precision libm over the ranges given, found by
+// trying every float in them (fastPow on a dense grid), and checked by
+// ESBenchmark --math:
+//
+//   fastExp2(x)      x in [-126, 127]            relative 2.5e-7
+//   fastLog2(x)      x in [0.5, 2]               absolute 1.6e-7
+//                    any other normal x > 0      within an ulp of the result
+//   fastPow(x, y)    x in [0, 1], y in [1/8, 8]  absolute 2.5e-7
+//   fastMtof(m)      m in [-20, 140]             relative 6.5e-7 (0.0011 cents)
+//   fastTanh(x)      any x                       absolute 1.6e-7
+//   fastSin(x)       |x| <= 4                    absolute 3.5e-7
+//                    |x| <= 100                  absolute 7e-6, from reducing x
+//   fastSin2Pi(p)    |p| <= 1000                 absolute 2.2e-7
+//   fastTan(x)       x in [0, 0.45pi]            relative 1.5e-6
+//                    x in [0, 0.49pi]            relative 7e-6, as the pole
+//                                                nears; denormal x gives 0
+//
+// That's at or below float resolution of a full scale signal and far under
+// the smallest pitch or gain step anyone can hear. Out of range input is
+// clamped rather than trapped so finite input never gives inf or NaN, and
+// fastPow returns 0 for x <= 0.
+
+namespace fastmath
+{
+    // Taylor series of 2^f around 0; with f in [-0.5, 0.5] the first
+    // dropped term is below 1.2e-7
+    static const float exp2C1 = 0.6931471806f;
+    static const float exp2C2 = 0.2402265070f;
+    static const float exp2C3 = 0.0555041087f;
+    static const float exp2C4 = 0.0096181291f;
+    static const float exp2C5 = 0.0013333558f;
+    static const float exp2C6 = 0.0001540353f;
+
+    // log2(m) = 2/ln2 * atanh((m-1)/(m+1)), odd series to z^7 with the
+    // mantissa folded into [sqrt(1/2), sqrt(2)] so |z| <= 0.172
+    static const float log2C1 = 2.8853900818f;
+    static const float log2C3 = 0.9617966939f;
+    static const float log2C5 = 0.5770780164f;
+    static const float log2C7 = 0.4121985831f;
+
+    // Taylor series of sin to x^11 on [-pi/2, pi/2]
+    static const float sinC3 = -1.f / 6.f;
+    static const float sinC5 = 1.f / 120.f;
+    static const float sinC7 = -1.f / 5040.f;
+    static const float sinC9 = 1.f / 362880.f;
+    static const float sinC11 = -1.f / 39916800.f;
+
+    static const float log2e = 1.4426950409f;
+    static const float sqrt2 = 1.4142135624f;
+    static const float twoPi = 6.2831853072f;
+    static const float invTwoPi = 0.1591549431f;
+    static const float minNormal = 1.17549435e-38f;
+
+    inline float bitsToFloat(int32_t bits) { float x; std::memcpy(&x, &bits, 4); return x; }
+    inline int32_t floatToBits(float x) { int32_t b; std::memcpy(&b, &x, 4); return b; }
+}
+
+//==============================================================================
+inline float fastExp2(float x)
+{
+    using namespace fastmath;
+    x = x < -126.f ? -126.f : (x > 127.f ? 127.f : x);
+    float n = std::floor(x + 0.5f);
+    float f = x - n;
+    float p = 1.f + f * (exp2C1 + f * (exp2C2 + f * (exp2C3 + f * (exp2C4 + f * (exp2C5 + f * exp2C6)))));
+    return p * bitsToFloat(((int32_t) n + 127) << 23);
+}
+
+inline float fastLog2(float x)
+{
+    using namespace fastmath;
+    x = x < minNormal ? minNormal : x;
+    int32_t bits = floatToBits(x);
+    float e = (float) ((bits >> 23) - 127);
+    float m = bitsToFloat((bits & 0x007fffff) | 0x3f800000);
+    if (m > sqrt2)
+    {
+        m *= 0.5f;
+        e += 1.f;
+    }
+    float z = (m - 1.f) / (m + 1.f);
+    float z2 = z * z;
+    return e + z * (log2C1 + z2 * (log2C3 + z2 * (log2C5 + z2 * log2C7)));
+}
+
+inline float fastPow(float x, float y)
+{
+    return x > 0.f ? fastExp2(y * fastLog2(x)) : 0.f;
+}
+
+inline float fastMtof(float m)
+{
+    return 440.f * fastExp2((m - 69.f) * (1.f / 12.f));
+}
+
+inline float fastTanh(float x)
+{
+    x = x < -9.f ? -9.f : (x > 9.f ? 9.f : x);
+    float e = fastExp2(x * (2.f * fastmath::log2e));
+    return (e - 1.f) / (e + 1.f);
+}
+
+inline float fastSin2Pi(float p)
+{
+    using namespace fastmath;
+    // Reduce to [-0.5, 0.5) turns then fold onto [-0.25, 0.25]
+    float t = p - std::floor(p + 0.5f);
+    if (t > 0.25f) t = 0.5f - t;
+    else if (t < -0.25f) t = -0.5f - t;
+    float x = twoPi * t;
+    float x2 = x * x;
+    return x * (1.f + x2 * (sinC3 + x2 * (sinC5 + x2 * (sinC7 + x2 * (sinC9 + x2 * sinC11)))));
+}
+
+inline float fastSin(float x)
+{
+    return fastSin2Pi(x * fastmath::invTwoPi);
+}
+
+inline float fastTan(float x)
+{
+    float p = x * fastmath::invTwoPi;
+    return fastSin2Pi(p) / fastSin2Pi(p + 0.25f);
+}
+
+//==============================================================================
+inline float4 fastExp2(float4 x)
+{
+    using namespace fastmath;
+    x = vmin(vmax(x, float4::broadcast(-126.f)), float4::broadcast(127.f));
+    float4 n = vfloor(x + float4::broadcast(0.5f));
+    float4 f = x - n;
+    float4 p = float4::broadcast(exp2C6);
+    p = p * f + float4::broadcast(exp2C5);
+    p = p * f + float4::broadcast(exp2C4);
+    p = p * f + float4::broadcast(exp2C3);
+    p = p * f + float4::broadcast(exp2C2);
+    p = p * f + float4::broadcast(exp2C1);
+    p = p * f + float4::broadcast(1.f);
+    return p * vpow2i(n);
+}
+
+inline float4 fastLog2(float4 x)
+{
+    using namespace fastmath;
+    const float4 one = float4::broadcast(1.f);
+    float4 e;
+    float4 m = vmantissa(vmax(x, float4::broadcast(minNormal)), e);
+    float4 fold = cmplt(float4::broadcast(sqrt2), m);
+    m = select(fold, m * float4::broadcast(0.5f), m);
+    e = e + (fold & one);
+    float4 z = (m - one) / (m + one);
+    float4 z2 = z * z;
+    float4 p = float4::broadcast(log2C7);
+    p = p * z2 + float4::broadcast(log2C5);
+    p = p * z2 + float4::broadcast(log2C3);
+    p = p * z2 + float4::broadcast(log2C1);
+    return e + z * p;
+}
+
+inline float4 fastPow(float4 x, float4 y)
+{
+    const float4 zero = float4::broadcast(0.f);
+    return select(cmplt(zero, x), fastExp2(y * fastLog2(x)), zero);
+}
+
+inline float4 fastMtof(float4 m)
+{
+    return float4::broadcast(440.f) *
+    fastExp2((m - float4::broadcast(69.f)) * float4::broadcast(1.f / 12.f));
+}
+
+inline float4 fastTanh(float4 x)
+{
+    const float4 one = float4::broadcast(1.f);
+    x = vmin(vmax(x, float4::broadcast(-9.f)), float4::broadcast(9.f));
+    float4 e = fastExp2(x * float4::broadcast(2.f * fastmath::log2e));
+    return (e - one) / (e + one);
+}
+
+inline float4 fastSin2Pi(float4 p)
+{
+    using namespace fastmath;
+    const float4 half = float4::broadcast(0.5f);
+    float4 t = p - vfloor(p + half);
+    float4 folded = select(cmplt(t, float4::broadcast(0.f)), float4::broadcast(-0.5f), half) - t;
+    t = select(cmplt(float4::broadcast(0.25f), vabs(t)), folded, t);
+    float4 x = float4::broadcast(twoPi) * t;
+    float4 x2 = x * x;
+    float4 s = float4::broadcast(sinC11);
+    s = s * x2 + float4::broadcast(sinC9);
+    s = s * x2 + float4::broadcast(sinC7);
+    s = s * x2 + float4::broadcast(sinC5);
+    s = s * x2 + float4::broadcast(sinC3);
+    s = s * x2 + float4::broadcast(1.f);
+    return x * s;
+}
+
+inline float4 fastSin(float4 x)
+{
+    return fastSin2Pi(x * float4::broadcast(fastmath::invTwoPi));
+}
+
+inline float4 fastTan(float4 x)
+{
+    float4 p = x * float4::broadcast(fastmath::invTwoPi);
+    return fastSin2Pi(p) / fastSin2Pi(p + float4::broadcast(0.25f));
+}
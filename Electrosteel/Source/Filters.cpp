@@ -11,17 +11,100 @@
 #include "Filters.h"
 #include "PluginProcessor.h"
 
+//==============================================================================
+SVFBank::SVFBank()
+{
+    reset();
+    setType(LowpassFilter);
+}
+
+void SVFBank::setType(FilterType type)
+{
+    switch (type) {
+        case HighpassFilter:
+            cH = 1.f; cB = 0.f; cBK = -1.f; cL = -1.f;
+            break;
+            
+        case BandpassFilter:
+            cH = 0.f; cB = 1.f; cBK = 0.f; cL = 0.f;
+            break;
+            
+        case LowpassFilter:
+        default:
+            cH = 0.f; cB = 0.f; cBK = 0.f; cL = 1.f;
+            break;
+    }
+}
+
+void SVFBank::reset()
+{
+    for (int v = 0; v < NUM_STRINGS; ++v)
+    {
+        ic1eq[v] = 0.f;
+        ic2eq[v] = 0.f;
+    }
+}
+
+void SVFBank::resetVoice(int v)
+{
+    ic1eq[v] = 0.f;
+    ic2eq[v] = 0.f;
+}
+
+void SVFBank::tick(float samples[][NUM_STRINGS], const float g[][NUM_STRINGS],
+                   const float k[][NUM_STRINGS], uint32_t voiceMask, int numSamples)
+{
+    const float4 one = float4::broadcast(1.f);
+    const float4 two = float4::broadcast(2.f);
+    const float4 vcH = float4::broadcast(cH);
+    const float4 vcB = float4::broadcast(cB);
+    const float4 vcBK = float4::broadcast(cBK);
+    const float4 vcL = float4::broadcast(cL);
+    
+    for (int v = 0; v < NUM_STRINGS; v += SIMD_WIDTH)
+    {
+        if (!voiceGroupIsActive(voiceMask, v)) continue;
+        
+        float4 ic1 = float4::load(&ic1eq[v]);
+        float4 ic2 = float4::load(&ic2eq[v]);
+        
+        for (int s = 0; s < numSamples; ++s)
+        {
+            float4 v0 = float4::load(&samples[s][v]);
+            float4 G = float4::load(&g[s][v]);
+            float4 K = float4::load(&k[s][v]);
+            
+            float4 a1 = one / (one + G * (G + K));
+            float4 a2 = G * a1;
+            float4 a3 = G * a2;
+            
+            float4 v3 = v0 - ic2;
+            float4 v1 = a1 * ic1 + a2 * v3;
+            float4 v2 = ic2 + a2 * ic1 + a3 * v3;
+            ic1 = two * v1 - ic1;
+            ic2 = two * v2 - ic2;
+            
+            float4 out = vcH * v0 + (vcB + vcBK * K) * v1 + vcL * v2;
+            out.store(&samples[s][v]);
+        }
+        
+        ic1.store(&ic1eq[v]);
+        ic2.store(&ic2eq[v]);
+    }
+}
+
 //==============================================================================
 Filter::Filter(const String& n, ESAudioProcessor& p,
                              AudioProcessorValueTreeState& vts) :
 AudioComponent(n, p, vts, cFilterParams, true)
-{    
-    for (int i = 0; i < NUM_STRINGS; i++)
+{
+    for (int s = 0; s < RENDER_BLOCK_SIZE; ++s)
     {
-        tSVF_init(&lowpass[i], SVFTypeLowpass, 2000.f, 0.7f, &processor.leaf);
-        tSVF_init(&highpass[i], SVFTypeHighpass, 2000.f, 0.7f, &processor.leaf);
-        tSVF_init(&bandpass[i], SVFTypeBandpass, 2000.f, 0.7f, &processor.leaf);
-        //tVZFilter_init(&filters[i], Morph, 2000.f, 1.0f, &processor.leaf);
+        for (int v = 0; v < NUM_STRINGS; ++v)
+        {
+            g[s][v] = 0.f;
+            k[s][v] = 1.f;
+        }
     }
     
     afpFilterType = vts.getRawParameterValue(n + " Type");
@@ -29,18 +112,15 @@ AudioComponent(n, p, vts, cFilterParams, true)
 
 Filter::~Filter()
 {
-    for (int i = 0; i < NUM_STRINGS; i++)
-    {
-        tSVF_free(&lowpass[i]);
-        tSVF_free(&highpass[i]);
-        tSVF_free(&bandpass[i]);
-        //tVZFilter_free(&filters[i]);
-    }
 }
 
 void Filter::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
     AudioComponent::prepareToPlay(sampleRate, samplesPerBlock);
+    piOverSampleRate = PI / sampleRate;
+    // Keep the cutoff safely below nyquist so tan doesn't blow up
+    maxCutoff = jmin(20000.f, 0.49f * (float)sampleRate);
+    svf.reset();
 }
 
 void Filter::frame()
@@ -49,76 +129,59 @@ void Filter::frame()
     enabled = afpEnabled == nullptr || *afpEnabled > 0;
     
     currentFilterType = FilterType(int(*afpFilterType));
-    switch (currentFilterType) {
-        case LowpassFilter:
-            filterTick = &Filter::lowpassTick;
-            break;
-            
-        case HighpassFilter:
-            filterTick = &Filter::highpassTick;
-            break;
-            
-        case BandpassFilter:
-            filterTick = &Filter::bandpassTick;
-            break;
-            
-        default:
-            filterTick = &Filter::lowpassTick;
-            break;
-    }
+    svf.setType(currentFilterType);
 }
 
-void Filter::tick(float* samples)
+void Filter::tick(float samples[][NUM_STRINGS], int numSamples, uint32_t voices)
 {
     if (!enabled) return;
     
-//    float a = sampleInBlock * invBlockSize;
-    
-    for (int v = 0; v < processor.numVoicesActive; ++v)
+    // The modulated parameters still have to be ticked one voice at a time,
+    // so work out coefficients for the whole block first and then run the
+    // filters for all voices together
+    for (uint32_t m = voices; m; m &= m - 1)
     {
-        float midiCutoff = quickParams[FilterCutoff][v]->tick();
-        float keyFollow = quickParams[FilterKeyFollow][v]->tick();
-        float q = quickParams[FilterResonance][v]->tick();
-        
-        LEAF_clip(0.f, keyFollow, 1.f);
-        
+        int v = lowestVoice(m);
         float follow = processor.voiceNote[v];
-        //float cutoff = (midiCutoff * (1.f - keyFollow)) + ((midiCutoff + follow) * keyFollow);
-        float cutoff = midiCutoff + (follow * keyFollow);
-        cutoff = fabsf(mtof(cutoff));
-        //cutoff = LEAF_clip(0.0f, cutoff*32.f, 4095.f);
-        q = q < 0.1f ? 0.1f : q;
         
-        (this->*filterTick)(samples[v], v, cutoff, q, keyFollow);
+        for (int s = 0; s < numSamples; ++s)
+        {
+            float midiCutoff = quickParams[FilterCutoff][v]->tick(s);
+            float keyFollow = quickParams[FilterKeyFollow][v]->tick(s);
+            float q = quickParams[FilterResonance][v]->tick(s);
+            
+            LEAF_clip(0.f, keyFollow, 1.f);
+            
+            //float cutoff = (midiCutoff * (1.f - keyFollow)) + ((midiCutoff + follow) * keyFollow);
+            // Cutoff stays a midi note and q stays q here; both become
+            // coefficients below, a vector at a time
+            g[s][v] = midiCutoff + (follow * keyFollow);
+            k[s][v] = q;
+        }
     }
     
-    sampleInBlock++;
-}
-
-void Filter::lowpassTick(float& sample, int v, float cutoff, float q, float morph)
-{
-    //tVZFilter_setMorphOnly(&filters[v], morph);
-    //tVZFilter_setFreqAndBandwidth(&filters[v], cutoff + 200.0f, q + .01f);
-    //sample = tVZFilter_tick(&filters[v], sample);
-    tSVF_setFreqAndQ(&lowpass[v], cutoff, q);
-    sample = tSVF_tick(&lowpass[v], sample);
-}
-
-void Filter::highpassTick(float& sample, int v, float cutoff, float q, float morph)
-{
-    //tVZFilter_setMorphOnly(&filters[v], morph);
-    //tVZFilter_setFreqAndBandwidth(&filters[v], cutoff + 200.0f, q + 0.01f);
-    //sample = tVZFilter_tick(&filters[v], sample);
-    tSVF_setFreqAndQ(&highpass[v], cutoff, q);
-    sample = tSVF_tick(&highpass[v], sample);
+    const float4 vMaxCutoff = float4::broadcast(maxCutoff);
+    const float4 vPiOverSampleRate = float4::broadcast(piOverSampleRate);
+    const float4 minQ = float4::broadcast(0.1f);
+    const float4 one = float4::broadcast(1.f);
+    for (int s = 0; s < numSamples; ++s)
+    {
+        // Whole groups of voices at a time; the idle lanes in a sounding
+        // group filter zeros and their output is never read
+        for (int v = 0; v < NUM_STRINGS; v += SIMD_WIDTH)
+        {
+            if (!voiceGroupIsActive(voices, v)) continue;
+            float4 cutoff = vmin(fastMtof(float4::load(&g[s][v])), vMaxCutoff);
+            fastTan(cutoff * vPiOverSampleRate).store(&g[s][v]);
+            (one / vmax(float4::load(&k[s][v]), minQ)).store(&k[s][v]);
+        }
+    }
+    
+    svf.tick(samples, g, k, voices, numSamples);
 }
 
-void Filter::bandpassTick(float& sample, int v, float cutoff, float q, float morph)
+void Filter::retireVoice(int voice)
 {
-    //tVZFilter_setMorphOnly(&filters[v], morph);
-    //tVZFilter_setFreqAndBandwidth(&filters[v], cutoff + 200.0f, q + 0.01f);
-    //sample = tVZFilter_tick(&filters[v], sample);
-    tSVF_setFreqAndQ(&bandpass[v], cutoff, q);
-    sample = tSVF_tick(&bandpass[v], sample);
+    // Start the voice's next note from rest
+    svf.resetVoice(voice);
 }
-
@@ -12,9 +12,38 @@
 
 #include "Constants.h"
 #include "Utilities.h"
+#include "SIMD.h"
 
 class ESAudioProcessor;
 
+//==============================================================================
+// State variable filters for every string held as structure-of-arrays so they
+// can be run SIMD_WIDTH strings at a time. Same trapezoidal SVF as LEAF's tSVF;
+// the output mix picks the lowpass/highpass/bandpass response.
+class SVFBank
+{
+public:
+    //==============================================================================
+    SVFBank();
+    
+    void setType(FilterType type);
+    void reset();
+    void resetVoice(int v);
+    
+    // g is tan(pi * cutoff / sampleRate) and k is 1/Q, both laid out
+    // [sample][voice] like the samples they're applied to
+    void tick(float samples[][NUM_STRINGS], const float g[][NUM_STRINGS],
+              const float k[][NUM_STRINGS], uint32_t voiceMask, int numSamples);
+    
+private:
+    alignas(16) float ic1eq[NUM_STRINGS];
+    alignas(16) float ic2eq[NUM_STRINGS];
+    
+    // Output = cH*input + (cB + cBK*k)*band + cL*low
+    float cH, cB, cBK, cL;
+};
+
+//==============================================================================
 class Filter : public AudioComponent
 {
 public:
@@ -25,19 +54,19 @@ public:
     //==============================================================================
     void prepareToPlay (double sampleRate, int samplesPerBlock);
     void frame();
-    void tick(float* samples);
+    void tick(float samples[][NUM_STRINGS], int numSamples, uint32_t voices);
+    
+    void retireVoice(int voice);
     
 private:
     
-    void (Filter::*filterTick)(float& sample, int v, float cutoff, float q, float morph);
-    void lowpassTick(float& sample, int v, float cutoff, float q, float morph);
-    void highpassTick(float& sample, int v, float cutoff, float q, float morph);
-    void bandpassTick(float& sample, int v, float cutoff, float q, float morph);
+    SVFBank svf;
+    
+    alignas(16) float g[RENDER_BLOCK_SIZE][NUM_STRINGS];
+    alignas(16) float k[RENDER_BLOCK_SIZE][NUM_STRINGS];
     
-    //tVZFilter filters[NUM_STRINGS];
-    tSVF lowpass[NUM_STRINGS];
-    tSVF highpass[NUM_STRINGS];
-    tSVF bandpass[NUM_STRINGS];
+    float piOverSampleRate = 0.f;
+    float maxCutoff = 20000.f;
     
     std::atomic<float>* afpFilterType;
     FilterType currentFilterType = FilterTypeNil;
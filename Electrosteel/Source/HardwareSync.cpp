@@ -0,0 +1,152 @@
+/*
+  ==============================================================================
+
+    HardwareSync.cpp
+
+  ==============================================================================
+*/
+
+#include "HardwareSync.h"
+#include "PluginProcessor.h"
+
+//==============================================================================
+HardwareSync::HardwareSync(ESAudioProcessor& p, SysexSender& s) :
+processor(p),
+sender(s)
+{
+}
+
+HardwareSync::~HardwareSync()
+{
+    stopTimer();
+}
+
+void HardwareSync::setEnabled(bool shouldBeEnabled)
+{
+    if (enabled == shouldBeEnabled) return;
+    enabled = shouldBeEnabled;
+    
+    // Nothing the hardware has is known any more
+    hasAcknowledgedState = false;
+    sentId = -1;
+    numTimeouts = 0;
+    
+    if (enabled) startTimer(HARDWARE_SYNC_INTERVAL_MS);
+    else stopTimer();
+}
+
+void HardwareSync::handleSysex(const uint8* data, int size)
+{
+    // 7D version 4 idHi idLo
+    if (size < 5 || data[0] != SYSEX_PACKED_ID || data[1] != SYSEX_PACKED_VERSION ||
+        data[2] != 4) return;
+    acknowledgedId = (data[3] << 7) | data[4];
+}
+
+//==============================================================================
+void HardwareSync::timerCallback()
+{
+    if (sender.getFormat() != PackedSysexFormat) return;
+    
+    if (sentId >= 0)
+    {
+        if (acknowledgedId == sentId)
+        {
+            acknowledgedState = sentState;
+            hasAcknowledgedState = true;
+            sentId = -1;
+            numTimeouts = 0;
+        }
+        else if (sender.isSending())
+        {
+            // The timeout runs from when the last of it went out
+            sentTime = Time::getMillisecondCounter();
+            return;
+        }
+        else if (Time::getMillisecondCounter() - sentTime < HARDWARE_SYNC_TIMEOUT_MS) return;
+        else
+        {
+            sentId = -1;
+            if (++numTimeouts >= HARDWARE_SYNC_MAX_TIMEOUTS)
+            {
+                int doublings = jmin(numTimeouts - HARDWARE_SYNC_MAX_TIMEOUTS, 16);
+                uint32 backoff = jmin((uint32)HARDWARE_SYNC_MAX_BACKOFF_MS,
+                                      (uint32)HARDWARE_SYNC_TIMEOUT_MS << doublings);
+                retryTime = Time::getMillisecondCounter() + backoff;
+                DBG("Hardware sync: no acknowledgement, retrying in " + String(backoff) + "ms");
+            }
+        }
+    }
+    // Leave full sends to finish first
+    if (sender.isSending()) return;
+    if (!isResponding() && (int32)(Time::getMillisecondCounter() - retryTime) < 0) return;
+    
+    HardwareState current;
+    processor.captureHardwareState(current);
+    
+    MemoryOutputStream records;
+    Array<WaveTableData::Ptr> tables;
+    if (!writeChanges(current, records, tables)) return;
+    
+    sentId = nextId;
+    nextId = (nextId + 1) & 16383;
+    sentState = current;
+    sentTime = Time::getMillisecondCounter();
+    sender.sendDelta(sentId, records.getMemoryBlock(), tables);
+}
+
+bool HardwareSync::writeChanges(const HardwareState& current, MemoryOutputStream& records,
+                                Array<WaveTableData::Ptr>& tables)
+{
+    // Everything counts as changed until the hardware has acknowledged
+    // something, or if the layout has changed under it
+    const HardwareState& last = acknowledgedState;
+    bool all = !hasAcknowledgedState;
+    
+    for (int i = 0; i < current.parameters.size(); ++i)
+    {
+        if (!all && i < last.parameters.size() && current.parameters[i] == last.parameters[i]) continue;
+        
+        records.writeByte(0);
+        records.writeShort((short)i);
+        records.writeFloat(current.parameters[i]);
+    }
+    
+    for (int i = 0; i < current.mappingSources.size(); ++i)
+    {
+        if (!all && i < last.mappingSources.size() &&
+            current.mappingSources[i] == last.mappingSources[i] &&
+            current.mappingEnds[i] == last.mappingEnds[i]) continue;
+        
+        records.writeByte(1);
+        records.writeShort((short)(i / 3));
+        records.writeByte((char)(i % 3));
+        records.writeShort((short)current.mappingSources[i]);
+        records.writeFloat(current.mappingEnds[i]);
+    }
+    
+    bool allCells = all || current.copedentNumber != last.copedentNumber;
+    for (int i = 0; i < current.copedent.size(); ++i)
+    {
+        if (!allCells && i < last.copedent.size() && current.copedent[i] == last.copedent[i]) continue;
+        
+        records.writeByte(2);
+        records.writeByte((char)current.copedentNumber);
+        records.writeByte((char)(i / 12));
+        records.writeByte((char)(i % 12));
+        records.writeFloat(current.copedent[i]);
+    }
+    
+    for (int i = 0; i < current.tables.size(); ++i)
+    {
+        if (!all && i < last.tables.size() && current.tables[i] == last.tables[i]) continue;
+        
+        WaveTableData::Ptr data = current.tables[i];
+        records.writeByte(3);
+        records.writeByte((char)i);
+        records.writeByte(data != nullptr ? 1 : 0);
+        if (data != nullptr) tables.add(data);
+    }
+    
+    return records.getDataSize() > 0;
+}
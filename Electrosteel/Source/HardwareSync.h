@@ -0,0 +1,105 @@
+/*
+  ==============================================================================
+
+    HardwareSync.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SysexSender.h"
+
+class ESAudioProcessor;
+
+// How often changes are looked for, and at most how often a delta goes out
+#define HARDWARE_SYNC_INTERVAL_MS 50
+// A delta not acknowledged this long after it finished sending is taken as
+// lost, and its changes go out again in the next one
+#define HARDWARE_SYNC_TIMEOUT_MS 1000
+// After this many deltas in a row time out the hardware is taken to not be
+// listening, and each retry waits twice as long as the one before
+#define HARDWARE_SYNC_MAX_TIMEOUTS 4
+#define HARDWARE_SYNC_MAX_BACKOFF_MS 60000
+
+//==============================================================================
+// Everything the hardware mirrors, as it is now or as the hardware last
+// acknowledged it
+struct HardwareState
+{
+    // In paramIds order
+    Array<float> parameters;
+    // Three targets per parameter, also in paramIds order. The source is
+    // its index in sourceIds, or -1 for no mapping
+    Array<int> mappingSources;
+    Array<float> mappingEnds;
+    int copedentNumber = 0;
+    // Columns one after another, 12 strings each
+    Array<float> copedent;
+    // Per oscillator, null unless it's playing a user set
+    Array<WaveTableData::Ptr> tables;
+};
+
+//==============================================================================
+// Mirrors changes made in the plugin to the hardware as they happen. On the
+// message thread the current state is compared with the last state the
+// hardware acknowledged, and anything that differs goes out as a delta
+// transfer in the packed format, followed by any wavetable sets that
+// changed. Only one delta is in flight at a time: the next waits for the
+// hardware to acknowledge it, or to time out, so a burst of edits is
+// collected into one delta rather than queued up behind each other. Needs
+// firmware that reads the packed format; does nothing while the sender is
+// set to the legacy one.
+//
+// Wavetable sets go out with the delta that changes an oscillator to them,
+// and like everything else count as the hardware's only once it acknowledges
+// that delta. A set whose delta times out goes out again with the next one,
+// which after HARDWARE_SYNC_MAX_TIMEOUTS misses in a row waits out the
+// backoff, so hardware that isn't listening isn't sent big sets over and over.
+class HardwareSync : private Timer
+{
+public:
+    //==============================================================================
+    HardwareSync(ESAudioProcessor& processor, SysexSender& sender);
+    ~HardwareSync() override;
+    
+    //==============================================================================
+    // Message thread. Turning it on resends everything with the first delta
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return enabled; }
+    // False while backing off because deltas keep going unacknowledged
+    bool isResponding() const { return numTimeouts < HARDWARE_SYNC_MAX_TIMEOUTS; }
+    
+    // Audio thread. Picks acknowledgements out of the incoming sysex
+    void handleSysex(const uint8* data, int size);
+    
+private:
+    //==============================================================================
+    void timerCallback() override;
+    // Writes a record for everything in current that differs from the
+    // acknowledged state. False if nothing does
+    bool writeChanges(const HardwareState& current, MemoryOutputStream& records,
+                      Array<WaveTableData::Ptr>& tables);
+    
+    ESAudioProcessor& processor;
+    SysexSender& sender;
+    
+    bool enabled = false;
+    HardwareState acknowledgedState;
+    bool hasAcknowledgedState = false;
+    
+    // The delta in flight, if any
+    HardwareState sentState;
+    int sentId = -1;
+    uint32 sentTime = 0;
+    int nextId = 0;
+    
+    // Consecutive deltas that timed out, and when the next may go out
+    int numTimeouts = 0;
+    uint32 retryTime = 0;
+    
+    std::atomic<int> acknowledgedId { -1 };
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HardwareSync)
+};
@@ -12,258 +12,682 @@
 #include "PluginProcessor.h"
 
 //==============================================================================
-
-Oscillator::Oscillator(const String& n, ESAudioProcessor& p,
-                       AudioProcessorValueTreeState& vts) :
-AudioComponent(n, p, vts, cOscParams, true),
-MappingSourceModel(p, n, true, true, Colours::darkorange)
+// Minimum phase band-limited step after Brandt, "Hard Sync Without Aliasing":
+// a Blackman windowed sinc made minimum phase by folding its real cepstrum, then
+// integrated. Built once and stored as residuals against the ideal step and the
+// ideal ramp at MINBLEP_PHASES + 1 sub-sample offsets.
+struct MinBLEPTables
 {
-    for (int i = 0; i < processor.numInvParameterSkews; ++i)
-    {
-        sourceValues[i] = (float*) leaf_alloc(&p.leaf, sizeof(float) * NUM_STRINGS);
-        sources[i] = &sourceValues[i];
-    }
+    MinBLEPTables();
     
-    for (int i = 0; i < NUM_STRINGS; i++)
+    float step[MINBLEP_PHASES + 1][MINBLEP_LENGTH];
+    float ramp[MINBLEP_PHASES + 1][MINBLEP_LENGTH];
+    
+    // Group delay of the minimum phase step in samples. The integrated step
+    // settles to the ideal ramp delayed by this much, so the ramp residual is
+    // stored with it added back and the bank subtracts slope * rampDelay from
+    // the naive waveform instead, keeping the residual short.
+    float rampDelay;
+};
+
+MinBLEPTables::MinBLEPTables()
+{
+    const double pi = MathConstants<double>::pi;
+    const int n = 2 * MINBLEP_ZERO_CROSSINGS * MINBLEP_PHASES + 1;
+    int size = 1;
+    while (size < 8 * n) size <<= 1;
+    
+    std::vector<std::complex<double>> x(size, 0.0);
+    for (int i = 0; i < n; ++i)
     {
-        tMBSaw_init(&saw[i], &processor.leaf);
-        tMBPulse_init(&pulse[i], &processor.leaf);
-        tCycle_init(&sine[i], &processor.leaf);
-        tMBTriangle_init(&tri[i], &processor.leaf);
-        
-        tMBSaw_init(&sawPaired[i], &processor.leaf);
-        tMBPulse_init(&pulsePaired[i], &processor.leaf);
-        tCycle_init(&sinePaired[i], &processor.leaf);
-        tMBTriangle_init(&triPaired[i], &processor.leaf);
+        double t = (double) i / MINBLEP_PHASES - MINBLEP_ZERO_CROSSINGS;
+        double sinc = t == 0.0 ? 1.0 : sin(pi * t) / (pi * t);
+        double window = 0.42 - 0.5 * cos(2.0 * pi * i / (n - 1)) + 0.08 * cos(4.0 * pi * i / (n - 1));
+        x[i] = sinc * window;
     }
     
-    filterSend = std::make_unique<SmoothedParameter>(p, vts, n + " FilterSend");
+    // Real cepstrum, folded onto positive quefrencies, is the minimum phase version
+    fft(x, false);
+    for (auto& c : x) c = log(jmax(std::abs(c), 1.0e-12));
+    fft(x, true);
+    for (int i = 1; i < size / 2; ++i) x[i] *= 2.0;
+    for (int i = size / 2 + 1; i < size; ++i) x[i] = 0.0;
+    fft(x, false);
+    for (auto& c : x) c = std::exp(c);
+    fft(x, true);
     
-    afpShapeSet = vts.getRawParameterValue(n + " ShapeSet");
-}
-
-Oscillator::~Oscillator()
-{
-    for (int i = 0; i < processor.numInvParameterSkews; ++i)
+    std::vector<double> s(n), r(n);
+    double sum = 0.0;
+    for (int i = 0; i < n; ++i)
     {
-        leaf_free(&processor.leaf, (char*)sourceValues[i]);
+        sum += x[i].real();
+        s[i] = sum;
     }
+    double integral = 0.0;
+    for (int i = 0; i < n; ++i)
+    {
+        s[i] /= sum;
+        integral += s[i] / MINBLEP_PHASES;
+        r[i] = integral;
+    }
+    double delay = (double) (n - 1) / MINBLEP_PHASES - r[n - 1];
+    rampDelay = (float) delay;
     
-    for (int i = 0; i < NUM_STRINGS; i++)
+    for (int j = 0; j <= MINBLEP_PHASES; ++j)
     {
-        tMBSaw_free(&saw[i]);
-        tMBPulse_free(&pulse[i]);
-        tCycle_free(&sine[i]);
-        tMBTriangle_free(&tri[i]);
-        
-        tMBSaw_free(&sawPaired[i]);
-        tMBPulse_free(&pulsePaired[i]);
-        tCycle_free(&sinePaired[i]);
-        tMBTriangle_free(&triPaired[i]);
-        
-        if (waveTableFile.exists())
+        for (int k = 0; k < MINBLEP_LENGTH; ++k)
         {
-            tWaveOscS_free(&wave[i]);
+            int i = k * MINBLEP_PHASES + j;
+            bool inTable = i < n;
+            step[j][k] = inTable ? (float) (s[i] - 1.0) : 0.f;
+            ramp[j][k] = inTable ? (float) (r[i] - (double) i / MINBLEP_PHASES + delay) : 0.f;
         }
     }
-    DBG("Post exit: " + String(processor.leaf.allocCount) + " " + String(processor.leaf.freeCount));
 }
 
-void Oscillator::prepareToPlay (double sampleRate, int samplesPerBlock)
+static const MinBLEPTables& getMinBLEPTables()
 {
-    AudioComponent::prepareToPlay(sampleRate, samplesPerBlock);
-    for (int i = 0; i < NUM_STRINGS; i++)
+    static const MinBLEPTables tables;
+    return tables;
+}
+
+// Naive shapes over phase in [0, 1), all bipolar [-1, 1]
+static inline float4 sawShape(float4 p)
+{
+    return float4::broadcast(1.f) - float4::broadcast(2.f) * p;
+}
+
+static inline float4 pulseShape(float4 p, float4 width)
+{
+    return select(cmplt(p, width), float4::broadcast(1.f), float4::broadcast(-1.f));
+}
+
+static inline float4 triShape(float4 p, float4 width, float4 inc, float4 delay)
+{
+    const float4 one = float4::broadcast(1.f);
+    const float4 two = float4::broadcast(2.f);
+    float4 rising = cmplt(p, width);
+    float4 up = two / width;
+    float4 down = two / (one - width);
+    float4 naive = select(rising, up * p - one, one - down * (p - width));
+    float4 slope = select(rising, up, float4::broadcast(0.f) - down) * inc;
+    return naive - delay * slope;
+}
+
+//==============================================================================
+OscillatorBank::OscillatorBank()
+{
+    getMinBLEPTables();
+    reset();
+}
+
+void OscillatorBank::setSampleRate(double sampleRate)
+{
+    invSampleRate = 1.f / (float) sampleRate;
+}
+
+void OscillatorBank::reset()
+{
+    for (int v = 0; v < NUM_STRINGS; ++v)
     {
-        tMBSaw_setSampleRate(&saw[i], sampleRate);
-        tMBPulse_setSampleRate(&pulse[i], sampleRate);
-        tCycle_setSampleRate(&sine[i], sampleRate);
-        tMBTriangle_setSampleRate(&tri[i], sampleRate);
-        
-        tMBSaw_setSampleRate(&sawPaired[i], sampleRate);
-        tMBPulse_setSampleRate(&pulsePaired[i], sampleRate);
-        tCycle_setSampleRate(&sinePaired[i], sampleRate);
-        tMBTriangle_setSampleRate(&triPaired[i], sampleRate);
-        
-        if (waveTableFile.exists())
-        {
-            tWaveOscS_setSampleRate(&wave[i], sampleRate);
-        }
+        phase[v] = 0.f;
+        for (int i = 0; i < MINBLEP_BUFFER_SIZE; ++i) residual[i][v] = 0.f;
     }
+    for (int i = 0; i < NUM_STRINGS / SIMD_WIDTH; ++i) residualPos[i] = 0;
 }
 
-void Oscillator::frame()
+void OscillatorBank::tick(OscShapeSet shapeSet, float output[][NUM_STRINGS],
+                          const float freq[][NUM_STRINGS], const float shape[][NUM_STRINGS],
+                          uint32_t voiceMask, int numSamples)
 {
-    sampleInBlock = 0;
-    enabled = afpEnabled == nullptr || *afpEnabled > 0 ||
-    processor.sourceMappingCounts[getName()] > 0;
-    
-    currentShapeSet = OscShapeSet(int(*afpShapeSet));
-    switch (currentShapeSet) {
-        case SawPulseOscShapeSet:
-            shapeTick = &Oscillator::sawSquareTick;
-            break;
-            
-        case SineTriOscShapeSet:
-            shapeTick = &Oscillator::sineTriTick;
-            break;
-            
-        case SawOscShapeSet:
-            shapeTick = &Oscillator::sawTick;
-            break;
-            
-        case PulseOscShapeSet:
-            shapeTick = &Oscillator::pulseTick;
-            break;
-            
-        case SineOscShapeSet:
-            shapeTick = &Oscillator::sineTick;
-            break;
-            
-        case TriOscShapeSet:
-            shapeTick = &Oscillator::triTick;
-            break;
-            
-        case UserOscShapeSet:
-            shapeTick = &Oscillator::userTick;
-            break;
-            
-        default:
-            shapeTick = &Oscillator::sawSquareTick;
-            break;
+    for (int v = 0; v < NUM_STRINGS; v += SIMD_WIDTH)
+    {
+        if (!voiceGroupIsActive(voiceMask, v))
+        {
+            // Drop any corrections still queued for a group that's gone quiet
+            // so they don't land on its next note
+            for (int s = 0; s < numSamples; ++s)
+            {
+                float* r = &residual[(residualPos[v / SIMD_WIDTH] + s) & (MINBLEP_BUFFER_SIZE - 1)][v];
+                for (int i = 0; i < SIMD_WIDTH; ++i) r[i] = 0.f;
+            }
+        }
+        else switch (shapeSet) {
+            case SineTriOscShapeSet:
+                tickVoices<SineTriOscShapeSet>(v, output, freq, shape, numSamples);
+                break;
+                
+            case SawOscShapeSet:
+                tickVoices<SawOscShapeSet>(v, output, freq, shape, numSamples);
+                break;
+                
+            case PulseOscShapeSet:
+                tickVoices<PulseOscShapeSet>(v, output, freq, shape, numSamples);
+                break;
+                
+            case SineOscShapeSet:
+                tickVoices<SineOscShapeSet>(v, output, freq, shape, numSamples);
+                break;
+                
+            case TriOscShapeSet:
+                tickVoices<TriOscShapeSet>(v, output, freq, shape, numSamples);
+                break;
+                
+            default:
+                tickVoices<SawPulseOscShapeSet>(v, output, freq, shape, numSamples);
+                break;
+        }
+        
+        int& pos = residualPos[v / SIMD_WIDTH];
+        pos = (pos + numSamples) & (MINBLEP_BUFFER_SIZE - 1);
     }
 }
 
-void Oscillator::tick(float output[][NUM_STRINGS])
+template <OscShapeSet shapeSet>
+void OscillatorBank::tickVoices(int v, float output[][NUM_STRINGS], const float freq[][NUM_STRINGS],
+                                const float shape[][NUM_STRINGS], int numSamples)
 {
-    if (loadingTables || !enabled) return;
-
-    for (int v = 0; v < processor.numVoicesActive; ++v)
+    const bool hasWidth = shapeSet != SawOscShapeSet && shapeSet != SineOscShapeSet;
+    const float4 zero = float4::broadcast(0.f);
+    const float4 one = float4::broadcast(1.f);
+    const float4 half = float4::broadcast(0.5f);
+    const float4 minInc = float4::broadcast(-0.49f);
+    const float4 maxInc = float4::broadcast(0.49f);
+    const float4 invSr = float4::broadcast(invSampleRate);
+    const float4 delay = float4::broadcast(getMinBLEPTables().rampDelay);
+    
+    float4 p = float4::load(&phase[v]);
+    int pos = residualPos[v / SIMD_WIDTH];
+    
+    for (int s = 0; s < numSamples; ++s)
     {
-        if (!processor.voiceIsSounding[v]) continue;
-        
-        float pitch = quickParams[OscPitch][v]->tickNoSmoothing();
-        float fine = quickParams[OscFine][v]->tickNoSmoothing();
-        float freq = quickParams[OscFreq][v]->tickNoSmoothing();
-        float shape = quickParams[OscShape][v]->tickNoSmoothing();
-        float amp = quickParams[OscAmp][v]->tickNoSmoothing();
+        float4 inc = vmin(vmax(float4::load(&freq[s][v]) * invSr, minInc), maxInc);
+        float4 sh = float4::load(&shape[s][v]);
         
-        amp = amp < 0.f ? 0.f : amp;
+        float4 width = half;
+        if (shapeSet == PulseOscShapeSet)
+            width = sh;
+        else if (shapeSet == TriOscShapeSet)
+            width = vmin(vmax(sh, float4::broadcast(0.01f)), float4::broadcast(0.99f));
         
-        float note = processor.voiceNote[v];
-        float finalFreq = mtof(LEAF_clip(0, note + pitch + fine*0.01f, 127)) + freq;
-        //freq = freq < 10.f ? 0.f : freq
-        
-        float sample = 0.0f;
-        
-        shape = LEAF_clip(0.f, shape, 1.f);
-        (this->*shapeTick)(sample, v, finalFreq, shape);
-    
-        sample *= amp;
+        float4 next = p + inc;
+        float4 over = cmpge(next, one);
+        float4 under = cmplt(next, zero);
+        float4 wrapped = next - (over & one) + (under & one);
         
-        float normSample = (sample + 1.f) * 0.5f;
-        sourceValues[0][v] = normSample;
-        for (int i = 1; i < processor.numInvParameterSkews; ++i)
+        float4 events = over | under;
+        if (hasWidth) events = events | (cmplt(p, width) ^ cmplt(wrapped, width));
+        if (int mask = movemask(events))
         {
-            float invSkew = processor.quickInvParameterSkews[i];
-            sourceValues[i][v] = powf(normSample, invSkew);
+            alignas(16) float lanePhase[SIMD_WIDTH], laneInc[SIMD_WIDTH];
+            alignas(16) float laneWidth[SIMD_WIDTH], laneShape[SIMD_WIDTH];
+            p.store(lanePhase);
+            inc.store(laneInc);
+            width.store(laneWidth);
+            sh.store(laneShape);
+            for (int i = 0; i < SIMD_WIDTH; ++i)
+            {
+                if (mask & (1 << i))
+                    addCorrections<shapeSet>(v + i, pos, lanePhase[i], laneInc[i],
+                                             laneWidth[i], laneShape[i]);
+            }
         }
+        p = wrapped;
         
-        sample *= INV_NUM_OSCS;
+        float4 out;
+        switch (shapeSet) {
+            case SineTriOscShapeSet:
+            {
+                // Both from phase 0, as LEAF's paired tCycle and tMBTriangle
+                // were: the sine rising through zero, the triangle from its trough
+                float4 sine = fastSin2Pi(p);
+                out = sine + (triShape(p, width, inc, delay) - sine) * sh;
+                break;
+            }
+                
+            case SawOscShapeSet:
+                out = sawShape(p);
+                break;
+                
+            case PulseOscShapeSet:
+                out = pulseShape(p, width);
+                break;
+                
+            case SineOscShapeSet:
+                out = fastSin2Pi(p);
+                break;
+                
+            case TriOscShapeSet:
+                out = triShape(p, width, inc, delay);
+                break;
+                
+            default:
+            {
+                float4 saw = sawShape(p);
+                out = saw + (pulseShape(p, width) - saw) * sh;
+                break;
+            }
+        }
         
-        float f = filterSend->tickNoHooks();
+        float* r = &residual[pos][v];
+        out = out + float4::load(r);
+        zero.store(r);
+        out.store(&output[s][v]);
         
-        output[0][v] += sample*f * *afpEnabled;
-        output[1][v] += sample*(1.f-f) * *afpEnabled ;
+        pos = (pos + 1) & (MINBLEP_BUFFER_SIZE - 1);
     }
     
-    sampleInBlock++;
+    p.store(&phase[v]);
 }
 
-void Oscillator::sawSquareTick(float& sample, int v, float freq, float shape)
+template <OscShapeSet shapeSet>
+void OscillatorBank::addCorrections(int voice, int pos, float p, float inc, float width, float shape)
 {
-    tMBSaw_setFreq(&sawPaired[v], freq);
-    tMBPulse_setFreq(&pulsePaired[v], freq);
-    sample += tMBSaw_tick(&sawPaired[v]) * (1.0f - shape) * 2.f;
-    sample += tMBPulse_tick(&pulsePaired[v]) * shape * 2.f;
+    // Walk the unwrapped phase over this sample; the wrap sits at 0 or 1 and the
+    // width corner at width - 1, width or width + 1 depending on direction
+    const float next = p + inc;
+    const float dir = inc > 0.f ? 1.f : -1.f;
+    const float absInc = inc * dir;
+    auto crossed = [&](float e) { return inc > 0.f ? (p < e && e <= next) : (next < e && e <= p); };
+    auto fraction = [&](float e) { return (next - e) / inc; };
+    
+    // Change in slope per sample at the low corner of the triangle
+    float corner = 0.f;
+    if (shapeSet == TriOscShapeSet) corner = (2.f / width + 2.f / (1.f - width)) * absInc;
+    else if (shapeSet == SineTriOscShapeSet) corner = 8.f * absInc * shape;
+    
+    const float wraps[2] = { 0.f, 1.f };
+    for (float e : wraps)
+    {
+        if (!crossed(e)) continue;
+        if (shapeSet == TriOscShapeSet || shapeSet == SineTriOscShapeSet)
+            addSlope(voice, pos, fraction(e), corner);
+        else if (shapeSet != SineOscShapeSet)
+            addStep(voice, pos, fraction(e), 2.f * dir);
+    }
+    
+    const float corners[3] = { width - 1.f, width, width + 1.f };
+    for (float e : corners)
+    {
+        if (!crossed(e)) continue;
+        if (shapeSet == TriOscShapeSet || shapeSet == SineTriOscShapeSet)
+            addSlope(voice, pos, fraction(e), -corner);
+        else if (shapeSet == PulseOscShapeSet)
+            addStep(voice, pos, fraction(e), -2.f * dir);
+        else if (shapeSet == SawPulseOscShapeSet)
+            addStep(voice, pos, fraction(e), -2.f * dir * shape);
+    }
 }
 
-void Oscillator::sineTriTick(float& sample, int v, float freq, float shape)
+void OscillatorBank::addStep(int voice, int pos, float fraction, float height)
 {
-    tCycle_setFreq(&sinePaired[v], freq);
-    tMBTriangle_setFreq(&triPaired[v], freq);
-    sample += tCycle_tick(&sinePaired[v]) * (1.0f - shape);
-    sample += tMBTriangle_tick(&triPaired[v]) * shape * 2.f;;
+    const MinBLEPTables& tables = getMinBLEPTables();
+    float x = fraction * MINBLEP_PHASES;
+    int j = jlimit(0, MINBLEP_PHASES - 1, (int) x);
+    float f = x - j;
+    for (int k = 0; k < MINBLEP_LENGTH; ++k)
+    {
+        float a = tables.step[j][k];
+        float b = tables.step[j+1][k];
+        residual[(pos + k) & (MINBLEP_BUFFER_SIZE - 1)][voice] += height * (a + f * (b - a));
+    }
 }
 
-void Oscillator::sawTick(float& sample, int v, float freq, float shape)
+void OscillatorBank::addSlope(int voice, int pos, float fraction, float height)
 {
-    tMBSaw_setFreq(&saw[v], freq);
-    sample += tMBSaw_tick(&saw[v]) * 2.f;;
+    const MinBLEPTables& tables = getMinBLEPTables();
+    float x = fraction * MINBLEP_PHASES;
+    int j = jlimit(0, MINBLEP_PHASES - 1, (int) x);
+    float f = x - j;
+    for (int k = 0; k < MINBLEP_LENGTH; ++k)
+    {
+        float a = tables.ramp[j][k];
+        float b = tables.ramp[j+1][k];
+        residual[(pos + k) & (MINBLEP_BUFFER_SIZE - 1)][voice] += height * (a + f * (b - a));
+    }
 }
 
-void Oscillator::pulseTick(float& sample, int v, float freq, float shape)
+//==============================================================================
+WaveTableBank::WaveTableBank(ESAudioProcessor& p) :
+processor(p)
 {
-    tMBPulse_setFreq(&pulse[v], freq);
-    tMBPulse_setWidth(&pulse[v], shape);
-    sample += tMBPulse_tick(&pulse[v]) * 2.f;;
+    reset();
 }
 
-void Oscillator::sineTick(float& sample, int v, float freq, float shape)
+void WaveTableBank::setSampleRate(double sampleRate)
 {
-    tCycle_setFreq(&sine[v], freq);
-    sample += tCycle_tick(&sine[v]);
+    invSampleRate = 1.f / (float)sampleRate;
+    // Nothing above Nyquist at low sample rates either
+    invCutoff = 1.f / jmin(WAVETABLE_MAX_FREQ, 0.45f * (float)sampleRate);
 }
 
-void Oscillator::triTick(float& sample, int v, float freq, float shape)
+void WaveTableBank::reset()
 {
-    tMBTriangle_setFreq(&tri[v], freq);
-    tMBTriangle_setWidth(&tri[v], shape);
-    sample += tMBTriangle_tick(&tri[v]) * 2.f;;
+    for (int v = 0; v < NUM_STRINGS; ++v) phase[v] = 0.f;
+    forgetPicks();
 }
 
-void Oscillator::userTick(float& sample, int v, float freq, float shape)
+void WaveTableBank::forgetPicks()
 {
-    tWaveOscS_setFreq(&wave[v], freq);
-    tWaveOscS_setIndex(&wave[v], shape);
-    sample += tWaveOscS_tick(&wave[v]);
+    for (int g = 0; g < NUM_STRINGS / SIMD_WIDTH; ++g) picked[g] = false;
 }
 
-void Oscillator::setWaveTables(File file)
+void WaveTableBank::tick(const WaveTableData& data, float output[][NUM_STRINGS],
+                         const float freq[][NUM_STRINGS], const float shape[][NUM_STRINGS],
+                         uint32_t voiceMask, int numSamples)
+{
+    for (int v = 0; v < NUM_STRINGS; v += SIMD_WIDTH)
+    {
+        if (voiceGroupIsActive(voiceMask, v)) tickVoices(data, v, output, freq, shape, numSamples);
+        else picked[v / SIMD_WIDTH] = false;
+    }
+}
+
+// The lower and upper frame at the lower and upper level, from the lower
+// frame and level, into four table slots for lane i
+static void getTables(const WaveTableData& data, int f0, int l0, const float* tables[][SIMD_WIDTH],
+                      float sizes[][SIMD_WIDTH], int i)
+{
+    int f1 = jmin(f0 + 1, data.getNumFrames() - 1);
+    int l1 = jmin(l0 + 1, WAVETABLE_NUM_LEVELS - 1);
+    tables[0][i] = data.getLevel(f0, l0);
+    tables[1][i] = data.getLevel(f0, l1);
+    tables[2][i] = data.getLevel(f1, l0);
+    tables[3][i] = data.getLevel(f1, l1);
+    sizes[0][i] = (float)WaveTableData::getLevelSize(l0);
+    sizes[1][i] = (float)WaveTableData::getLevelSize(l1);
+}
+
+void WaveTableBank::tickVoices(const WaveTableData& data, int v, float output[][NUM_STRINGS],
+                               const float freq[][NUM_STRINGS], const float shape[][NUM_STRINGS],
+                               int numSamples)
 {
-    loadingTables = true;
+    const int interval = processor.controlRateMask + 1;
+    const int lastFrame = data.getNumFrames() - 1;
+    bool& groupPicked = picked[v / SIMD_WIDTH];
     
-    File loaded = processor.loadWaveTables(file.getFullPathName(), file);
+    const float4 zero = float4::broadcast(0.f);
+    const float4 one = float4::broadcast(1.f);
+    const float4 invSr = float4::broadcast(invSampleRate);
+    const float4 invInterval = float4::broadcast(processor.invControlRateInterval);
     
-    if (loaded.exists() && loaded != waveTableFile)
+    float4 p = float4::load(&phase[v]);
+    
+    // A ramp cut short by the end of the block counts as having got there
+    for (int start = 0; start < numSamples; start += interval)
     {
-        if (waveTableFile.exists())
+        // Per lane, the four tables ramping out then the four ramping in, as
+        // in getTables, with their weights at the start and end of the ramp
+        const float* tables[8][SIMD_WIDTH];
+        alignas(16) float from[8][SIMD_WIDTH];
+        alignas(16) float to[8][SIMD_WIDTH];
+        alignas(16) float sizes[4][SIMD_WIDTH];
+        bool fading = false;
+        
+        for (int i = 0; i < SIMD_WIDTH; ++i)
         {
-            for (int i = 0; i < NUM_STRINGS; ++i)
+            const int string = v + i;
+            
+            // Blend the two levels either side of where the top harmonic meets
+            // the cutoff, so the lower of them never goes past it
+            float top = fabsf(freq[start][string]) * (WAVETABLE_FRAME_SIZE / 2) * invCutoff;
+            float level = top > 0.5f ? fastLog2(top) + 1.f : 0.f;
+            level = LEAF_clip(0.f, level, WAVETABLE_NUM_LEVELS - 1.f);
+            int l0 = (int)level;
+            float levelMix = level - l0;
+            
+            float frame = LEAF_clip(0.f, shape[start][string], 1.f) * lastFrame;
+            int f0 = (int)frame;
+            float frameMix = frame - f0;
+            
+            float target[4];
+            target[0] = (1.f - frameMix) * (1.f - levelMix);
+            target[1] = (1.f - frameMix) * levelMix;
+            target[2] = frameMix * (1.f - levelMix);
+            target[3] = frameMix * levelMix;
+            
+            if (!groupPicked)
+            {
+                frames[string] = f0;
+                levels[string] = l0;
+                for (int t = 0; t < 4; ++t) weights[t][string] = target[t];
+            }
+            bool same = frames[string] == f0 && levels[string] == l0;
+            fading = fading || !same;
+            
+            // Data with fewer frames than the last pick's shouldn't get here,
+            // but a stale frame would read past its end
+            getTables(data, jmin(frames[string], lastFrame), levels[string], tables, sizes, i);
+            getTables(data, f0, l0, tables + 4, sizes + 2, i);
+            for (int t = 0; t < 4; ++t)
             {
-                tWaveOscS_free(&wave[i]);
+                from[t][i] = weights[t][string];
+                to[t][i] = same ? target[t] : 0.f;
+                from[t+4][i] = 0.f;
+                to[t+4][i] = same ? 0.f : target[t];
+                weights[t][string] = target[t];
             }
+            frames[string] = f0;
+            levels[string] = l0;
         }
-        waveTableFile = loaded;
+        groupPicked = true;
         
-        for (int i = 0; i < NUM_STRINGS; ++i)
+        // The second four only need reading if some lane changed tables
+        const int numTables = fading ? 8 : 4;
+        float4 weight[8], increment[8], size[4];
+        for (int t = 0; t < numTables; ++t)
         {
-            Array<tWaveTableS>& tables = processor.waveTables.getReference(waveTableFile.getFullPathName());
-            tWaveOscS_init(&wave[i], tables.getRawDataPointer(), tables.size(), &processor.leaf);
+            weight[t] = float4::load(from[t]);
+            increment[t] = (float4::load(to[t]) - weight[t]) * invInterval;
+        }
+        for (int l = 0; l < numTables / 2; ++l) size[l] = float4::load(sizes[l]);
+        
+        const int end = jmin(start + interval, numSamples);
+        for (int s = start; s < end; ++s)
+        {
+            p = p + float4::load(&freq[s][v]) * invSr;
+            p = p - vfloor(p);
+            // Rounding can land a tiny negative phase on 1
+            p = select(cmpge(p, one), zero, p);
+            
+            // Both frames at a level share a read position
+            float4 fraction[4];
+            alignas(16) float index[4][SIMD_WIDTH];
+            for (int l = 0; l < numTables / 2; ++l)
+            {
+                float4 position = p * size[l];
+                float4 whole = vfloor(position);
+                fraction[l] = position - whole;
+                whole.store(index[l]);
+            }
+            
+            float4 out = zero;
+            for (int t = 0; t < numTables; ++t)
+            {
+                const int l = ((t >> 2) << 1) | (t & 1);
+                alignas(16) float a[SIMD_WIDTH], b[SIMD_WIDTH];
+                for (int i = 0; i < SIMD_WIDTH; ++i)
+                {
+                    const float* sample = tables[t][i] + (int)index[l][i];
+                    a[i] = sample[0];
+                    b[i] = sample[1];
+                }
+                weight[t] = weight[t] + increment[t];
+                float4 x = float4::load(a);
+                out = out + weight[t] * (x + (float4::load(b) - x) * fraction[l]);
+            }
+            out.store(&output[s][v]);
         }
     }
     
-    loadingTables = false;
+    p.store(&phase[v]);
+}
+
+//==============================================================================
+
+Oscillator::Oscillator(const String& n, ESAudioProcessor& p,
+                       AudioProcessorValueTreeState& vts) :
+AudioComponent(n, p, vts, cOscParams, true),
+MappingSourceModel(p, n, true, true, true, Colours::darkorange),
+waveTableBank(p)
+{
+    for (int i = 0; i < processor.numInvParameterSkews; ++i)
+    {
+        sourceValues[i] = (float*) leaf_alloc(&p.leaf, sizeof(float) * NUM_STRINGS *
+                                              RENDER_BLOCK_SIZE);
+        sources[i] = &sourceValues[i];
+    }
+    audioRate = true;
+    
+    // Pitch is where a ramped control rate would be most audible
+    for (int v = 0; v < NUM_STRINGS; ++v)
+    {
+        quickParams[OscPitch][v]->setAudioRate(true);
+        quickParams[OscFine][v]->setAudioRate(true);
+        quickParams[OscFreq][v]->setAudioRate(true);
+    }
+    
+    for (int s = 0; s < RENDER_BLOCK_SIZE; ++s)
+    {
+        for (int v = 0; v < NUM_STRINGS; ++v)
+        {
+            freqs[s][v] = 0.f;
+            shapes[s][v] = 0.f;
+            amps[s][v] = 0.f;
+        }
+    }
+    
+    filterSend = std::make_unique<SmoothedParameter>(p, vts, n + " FilterSend");
+    
+    afpShapeSet = vts.getRawParameterValue(n + " ShapeSet");
+}
+
+Oscillator::~Oscillator()
+{
+    for (int i = 0; i < processor.numInvParameterSkews; ++i)
+    {
+        leaf_free(&processor.leaf, (char*)sourceValues[i]);
+    }
+    DBG("Post exit: " + String(processor.leaf.allocCount) + " " + String(processor.leaf.freeCount));
+}
+
+void Oscillator::prepareToPlay (double sampleRate, int samplesPerBlock)
+{
+    AudioComponent::prepareToPlay(sampleRate, samplesPerBlock);
+    bank.setSampleRate(sampleRate);
+    waveTableBank.setSampleRate(sampleRate);
+}
+
+void Oscillator::frame()
+{
+    sampleInBlock = 0;
+    enabled = afpEnabled == nullptr || *afpEnabled > 0 ||
+    processor.sourceMappingCounts[getName()] > 0;
+    
+    currentShapeSet = OscShapeSet(int(*afpShapeSet));
+}
+
+void Oscillator::beginBlock(int numSamples)
+{
+    // The bank's picks point into the set it last played, which is retired
+    // here and may be freed, and another set may later land at its address
+    WaveTableSet* previous = waveTables.get();
+    if (waveTables.update() != previous) waveTableBank.forgetPicks();
+    
+    for (int s = 0; s < numSamples; ++s)
+    {
+        send[s] = filterSend->tickNoHooks();
+    }
+}
+
+void Oscillator::tick(float output[][RENDER_BLOCK_SIZE][NUM_STRINGS], int numSamples,
+                      uint32_t voices)
+{
+    if (!enabled) return;
+    
+    float gain = *afpEnabled;
+    
+    for (uint32_t m = voices; m; m &= m - 1)
+    {
+        int v = lowestVoice(m);
+        float note = processor.voiceNote[v];
+        
+        for (int s = 0; s < numSamples; ++s)
+        {
+            float pitch = quickParams[OscPitch][v]->tickNoSmoothing(s);
+            float fine = quickParams[OscFine][v]->tickNoSmoothing(s);
+            float freq = quickParams[OscFreq][v]->tickNoSmoothing(s);
+            float shape = quickParams[OscShape][v]->tickNoSmoothing(s);
+            float amp = quickParams[OscAmp][v]->tickNoSmoothing(s);
+            
+            amps[s][v] = amp < 0.f ? 0.f : amp;
+            freqs[s][v] = fastMtof(LEAF_clip(0, note + pitch + fine*0.01f, 127)) + freq;
+            shapes[s][v] = LEAF_clip(0.f, shape, 1.f);
+        }
+    }
+    
+    // Everything runs through a bank a vector of strings at a time,
+    // including any strings in a sounding group that aren't sounding so the
+    // lanes stay whole. Their output is never read.
+    if (currentShapeSet == UserOscShapeSet)
+    {
+        if (WaveTableSet* set = waveTables.get())
+        {
+            waveTableBank.tick(*set->data, shapeSamples, freqs, shapes, voices, numSamples);
+        }
+        // Silent until the first set has loaded
+        else for (uint32_t m = voices; m; m &= m - 1)
+        {
+            int v = lowestVoice(m);
+            for (int s = 0; s < numSamples; ++s) shapeSamples[s][v] = 0.f;
+        }
+    }
+    else
+    {
+        bank.tick(currentShapeSet, shapeSamples, freqs, shapes, voices, numSamples);
+    }
+    
+    for (uint32_t m = voices; m; m &= m - 1)
+    {
+        int v = lowestVoice(m);
+        
+        for (int s = 0; s < numSamples; ++s)
+        {
+            float sample = shapeSamples[s][v] * amps[s][v];
+            
+            sourceValues[0][s*NUM_STRINGS + v] = (sample + 1.f) * 0.5f;
+            
+            sample *= INV_NUM_OSCS;
+            
+            output[0][s][v] += sample*send[s] * gain;
+            output[1][s][v] += sample*(1.f-send[s]) * gain;
+        }
+    }
+    
+    fillSkews(numSamples, voices);
+}
+
+void Oscillator::setWaveTables(File file)
+{
+    if (!file.exists() || file == waveTableFile) return;
+    
+    // Roots of sets are listed so they can be picked again
+    processor.waveTableFiles.addIfNotAlreadyThere(file);
+    
+    waveTableFile = file;
+    processor.waveTableLoader.load(*this, file);
 }
 
 //==============================================================================
 
 LowFreqOscillator::LowFreqOscillator(const String& n, ESAudioProcessor& p, AudioProcessorValueTreeState& vts) :
 AudioComponent(n, p, vts, cLowFreqParams, false),
-MappingSourceModel(p, n, true, true, Colours::chartreuse)
+MappingSourceModel(p, n, true, true, true, Colours::chartreuse)
 {
     for (int i = 0; i < p.numInvParameterSkews; ++i)
     {
-        sourceValues[i] = (float*) leaf_alloc(&p.leaf, sizeof(float) * NUM_STRINGS);
+        sourceValues[i] = (float*) leaf_alloc(&p.leaf, sizeof(float) * NUM_STRINGS *
+                                              RENDER_BLOCK_SIZE);
         sources[i] = &sourceValues[i];
     }
     
@@ -362,32 +786,31 @@ void LowFreqOscillator::frame()
     }
 }
 
-void LowFreqOscillator::tick()
+void LowFreqOscillator::tick(int numSamples, uint32_t voices)
 {
     if (!enabled) return;
-//    float a = sampleInBlock * invBlockSize;
     
-    for (int v = 0; v < processor.numVoicesActive; v++)
+    for (uint32_t m = voices; m; m &= m - 1)
     {
-        float rate = quickParams[LowFreqRate][v]->tickNoSmoothing();
-        float shape = quickParams[LowFreqShape][v]->tickNoSmoothing();
-        // Even though our oscs can handle negative frequency I think allowing the rate to
-        // go negative would be confusing behavior
-        rate = rate < 0.f ? 0.f : rate;
-        shape = LEAF_clip(0.f, shape, 1.f);
-        
-        float sample = 0;
-        (this->*shapeTick)(sample, v, rate, shape);
+        int v = lowestVoice(m);
         
-        float normSample = (sample + 1.f) * 0.5f;
-        sourceValues[0][v] = normSample;
-        for (int i = 1; i < processor.numInvParameterSkews; ++i)
+        for (int s = 0; s < numSamples; ++s)
         {
-            float invSkew = processor.quickInvParameterSkews[i];
-            sourceValues[i][v] = powf(normSample, invSkew);
+            float rate = quickParams[LowFreqRate][v]->tickNoSmoothing(s);
+            float shape = quickParams[LowFreqShape][v]->tickNoSmoothing(s);
+            // Even though our oscs can handle negative frequency I think allowing the rate to
+            // go negative would be confusing behavior
+            rate = rate < 0.f ? 0.f : rate;
+            shape = LEAF_clip(0.f, shape, 1.f);
+            
+            float sample = 0;
+            (this->*shapeTick)(sample, v, rate, shape);
+            
+            sourceValues[0][s*NUM_STRINGS + v] = (sample + 1.f) * 0.5f;
         }
     }
-    sampleInBlock++;
+    
+    fillSkews(numSamples, voices);
 }
 
 void LowFreqOscillator::sawSquareTick(float& sample, int v, float rate, float shape)
@@ -453,17 +876,18 @@ void LowFreqOscillator::noteOn(int voice, float velocity)
 
 NoiseGenerator::NoiseGenerator(const String& n, ESAudioProcessor& p, AudioProcessorValueTreeState& vts) :
 AudioComponent(n, p, vts, cNoiseParams, true),
-MappingSourceModel(p, n, true, true, Colours::darkorange)
+MappingSourceModel(p, n, true, true, true, Colours::darkorange)
 {
     for (int i = 0; i < p.numInvParameterSkews; ++i)
     {
-        sourceValues[i] = (float*) leaf_alloc(&p.leaf, sizeof(float) * NUM_STRINGS);
+        sourceValues[i] = (float*) leaf_alloc(&p.leaf, sizeof(float) * NUM_STRINGS *
+                                              RENDER_BLOCK_SIZE);
         sources[i] = &sourceValues[i];
     }
+    audioRate = true;
     
     for (int i = 0; i < NUM_STRINGS; i++)
     {
-        tNoise_init(&noise[i], WhiteNoise, &processor.leaf);
         tSVF_init(&bandpass[i], SVFTypeBandpass, 2000.f, 0.7f, &processor.leaf);
     }
     
@@ -481,7 +905,6 @@ NoiseGenerator::~NoiseGenerator()
     
     for (int i = 0; i < NUM_STRINGS; i++)
     {
-        tNoise_free(&noise[i]);
         tSVF_free(&bandpass[i]);
     }
 }
@@ -533,34 +956,45 @@ void NoiseGenerator::frame()
 //    }
 }
 
-void NoiseGenerator::tick(float output[][NUM_STRINGS])
+void NoiseGenerator::beginBlock(int numSamples)
+{
+    for (int s = 0; s < numSamples; ++s)
+    {
+        send[s] = filterSend->tickNoHooks();
+    }
+}
+
+void NoiseGenerator::tick(float output[][RENDER_BLOCK_SIZE][NUM_STRINGS], int numSamples,
+                          uint32_t voices)
 {
     if (!enabled) return;
-    //    float a = sampleInBlock * invBlockSize;
     
-    for (int v = 0; v < processor.numVoicesActive; v++)
-    {
-        float color = quickParams[NoiseColor][v]->tickNoSmoothing();
-        float amp = quickParams[NoiseAmp][v]->tickNoSmoothing();
-        color = color < 0.f ? 0.f : color;
-        color = mtof(color*100.f + 24.f);
-        amp = amp < 0.f ? 0.f : amp;
+    float gain = *afpEnabled;
     
-        tSVF_setFreq(&bandpass[v], color);
-        float sample = tSVF_tick(&bandpass[v], tNoise_tick(&noise[v])) * amp;
+    random.fill(whiteNoise, numSamples, voices);
+    
+    for (uint32_t m = voices; m; m &= m - 1)
+    {
+        int v = lowestVoice(m);
         
-        float normSample = (sample + 1.f) * 0.5f;
-        sourceValues[0][v] = normSample;
-        for (int i = 1; i < processor.numInvParameterSkews; ++i)
+        for (int s = 0; s < numSamples; ++s)
         {
-            float invSkew = processor.quickInvParameterSkews[i];
-            sourceValues[i][v] = powf(normSample, invSkew);
+            float color = quickParams[NoiseColor][v]->tickNoSmoothing(s);
+            float amp = quickParams[NoiseAmp][v]->tickNoSmoothing(s);
+            color = color < 0.f ? 0.f : color;
+            color = fastMtof(color*100.f + 24.f);
+            amp = amp < 0.f ? 0.f : amp;
+            
+            tSVF_setFreq(&bandpass[v], color);
+            float white = whiteNoise[s][v] * 2.f - 1.f;
+            float sample = tSVF_tick(&bandpass[v], white) * amp;
+            
+            sourceValues[0][s*NUM_STRINGS + v] = (sample + 1.f) * 0.5f;
+            
+            output[0][s][v] += sample*send[s] * gain;
+            output[1][s][v] += sample*(1.f-send[s]) * gain;
         }
-        
-        float f = filterSend->tickNoHooks();
-        
-        output[0][v] += sample*f * *afpEnabled;
-        output[1][v] += sample*(1.f-f) * *afpEnabled ;
     }
-    sampleInBlock++;
+    
+    fillSkews(numSamples, voices);
 }
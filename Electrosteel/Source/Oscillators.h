@@ -12,9 +12,100 @@
 
 #include "Constants.h"
 #include "Utilities.h"
+#include "SIMD.h"
+#include "VoiceRandom.h"
+#include "WaveTables.h"
 
 class ESAudioProcessor;
 
+// Sub-sample offsets and length, in samples, of the minBLEP correction tables
+#define MINBLEP_ZERO_CROSSINGS 16
+#define MINBLEP_PHASES 64
+#define MINBLEP_LENGTH (2*MINBLEP_ZERO_CROSSINGS)
+// Power of two at least MINBLEP_LENGTH
+#define MINBLEP_BUFFER_SIZE 64
+
+//==============================================================================
+// Band-limited saw/pulse/sine/tri for every string at once, SIMD_WIDTH strings
+// per vector. All shapes of a string share one phase, which keeps the paired
+// shape sets in phase. Steps and slope changes are smoothed with minBLEP and
+// integrated minBLEP residuals summed into a per string ring buffer; only the
+// strings that hit a discontinuity on a given sample drop into scalar code.
+class OscillatorBank
+{
+public:
+    //==============================================================================
+    OscillatorBank();
+    
+    void setSampleRate(double sampleRate);
+    void reset();
+    
+    // freq is in Hz and shape in [0, 1], both laid out [sample][voice] like output
+    void tick(OscShapeSet shapeSet, float output[][NUM_STRINGS], const float freq[][NUM_STRINGS],
+              const float shape[][NUM_STRINGS], uint32_t voiceMask, int numSamples);
+    
+private:
+    template <OscShapeSet shapeSet>
+    void tickVoices(int v, float output[][NUM_STRINGS], const float freq[][NUM_STRINGS],
+                    const float shape[][NUM_STRINGS], int numSamples);
+    template <OscShapeSet shapeSet>
+    void addCorrections(int voice, int pos, float phase, float inc, float width, float shape);
+    void addStep(int voice, int pos, float fraction, float height);
+    void addSlope(int voice, int pos, float fraction, float height);
+    
+    alignas(16) float phase[NUM_STRINGS];
+    alignas(16) float residual[MINBLEP_BUFFER_SIZE][NUM_STRINGS];
+    // Each group of voices has its own read position so groups can be
+    // ticked independently
+    int residualPos[NUM_STRINGS / SIMD_WIDTH];
+    float invSampleRate = 1.f / 44100.f;
+};
+
+//==============================================================================
+// User wavetables for every string at once, SIMD_WIDTH strings per vector.
+// Each string's pair of frames and pair of mip levels is picked at control
+// rate, every controlRateInterval samples from its pitch and shape at that
+// sample, and the four tables' weights ramp linearly from one pick to the
+// next. When a pick lands on different tables the old four ramp out while
+// the new four ramp in. Every sample reads and blends the tables for a whole
+// group of strings together, with only the table lookups done lane by lane.
+class WaveTableBank
+{
+public:
+    //==============================================================================
+    WaveTableBank(ESAudioProcessor& processor);
+    
+    void setSampleRate(double sampleRate);
+    void reset();
+    // Called when the data passed to tick changes, as picks into the old data
+    // can't be ramped from and may not be valid in the new
+    void forgetPicks();
+    
+    // freq is in Hz and shape in [0, 1], both laid out [sample][voice] like output
+    void tick(const WaveTableData& data, float output[][NUM_STRINGS], const float freq[][NUM_STRINGS],
+              const float shape[][NUM_STRINGS], uint32_t voiceMask, int numSamples);
+    
+private:
+    void tickVoices(const WaveTableData& data, int v, float output[][NUM_STRINGS],
+                    const float freq[][NUM_STRINGS], const float shape[][NUM_STRINGS],
+                    int numSamples);
+    
+    ESAudioProcessor& processor;
+    
+    alignas(16) float phase[NUM_STRINGS];
+    float invSampleRate = 1.f / 44100.f;
+    float invCutoff = 1.f / WAVETABLE_MAX_FREQ;
+    
+    // Each string's last pick, as its lower frame and level and the weights
+    // of the four tables they lead to, for the next pick to ramp from
+    int frames[NUM_STRINGS];
+    int levels[NUM_STRINGS];
+    float weights[4][NUM_STRINGS];
+    // Groups that weren't ticked last block, or whose picks were forgotten,
+    // start from their first pick without ramping
+    bool picked[NUM_STRINGS / SIMD_WIDTH];
+};
+
 //==============================================================================
 
 class Oscillator : public AudioComponent,
@@ -28,41 +119,47 @@ public:
     //==============================================================================
     void prepareToPlay (double sampleRate, int samplesPerBlock);
     void frame();
-    void tick(float output[][NUM_STRINGS]);
+    // Ticks the parameters shared by every voice and picks up any newly
+    // loaded wavetables; once per render block on the audio thread before
+    // tick() is called for any of the voices
+    void beginBlock(int numSamples);
+    void tick(float output[][RENDER_BLOCK_SIZE][NUM_STRINGS], int numSamples, uint32_t voices);
+    // Moves the shared parameters on without rendering anything
+    void skip(int numSamples) { filterSend->skip(numSamples); }
     
     //==============================================================================
+    // Starts loading file in the background; the oscillator keeps playing
+    // the previous tables, or silence, until it's ready
     void setWaveTables(File file);
+    // The file last asked for, which may still be loading
     File& getWaveTableFile() { return waveTableFile; }
+    // The tables being played; audio thread only
+    WaveTableSet* getWaveTables() { return waveTables.get(); }
+    
+    // WaveTableLoader thread only
+    void publishWaveTables(WaveTableSet* set) { waveTables.publish(set); }
+    void collectWaveTables() { waveTables.collect(); }
+    bool isWaitingForWaveTables() { return waveTables.isWaiting(); }
     
     OscShapeSet getCurrentShapeSet() { return currentShapeSet; }
+    // Any thread. The set parameter, which the audio thread picks up at the
+    // start of each frame, unlike currentShapeSet which it writes
+    OscShapeSet getShapeSetParameter() { return OscShapeSet(int(*afpShapeSet)); }
     
 private:
     
-    void (Oscillator::*shapeTick)(float& sample, int v, float freq, float shape);
-    void sawSquareTick(float& sample, int v, float freq, float shape);
-    void sineTriTick(float& sample, int v, float freq, float shape);
-    void sawTick(float& sample, int v, float freq, float shape);
-    void pulseTick(float& sample, int v, float freq, float shape);
-    void sineTick(float& sample, int v, float freq, float shape);
-    void triTick(float& sample, int v, float freq, float shape);
-    void userTick(float& sample, int v, float freq, float shape);
+    OscillatorBank bank;
+    WaveTableBank waveTableBank;
     
-    tMBSaw saw[NUM_STRINGS];
-    tMBPulse pulse[NUM_STRINGS];
-    tCycle sine[NUM_STRINGS];
-    tMBTriangle tri[NUM_STRINGS];
-    
-    // Using seperate objects for pairs to easily maintain phase relation
-    tMBSaw sawPaired[NUM_STRINGS];
-    tMBPulse pulsePaired[NUM_STRINGS];
-    tCycle sinePaired[NUM_STRINGS];
-    tMBTriangle triPaired[NUM_STRINGS];
-    
-    tWaveOscS wave[NUM_STRINGS];
+    alignas(16) float freqs[RENDER_BLOCK_SIZE][NUM_STRINGS];
+    alignas(16) float shapes[RENDER_BLOCK_SIZE][NUM_STRINGS];
+    alignas(16) float amps[RENDER_BLOCK_SIZE][NUM_STRINGS];
+    alignas(16) float shapeSamples[RENDER_BLOCK_SIZE][NUM_STRINGS];
     
     float* sourceValues[MAX_NUM_UNIQUE_SKEWS];
 
     std::unique_ptr<SmoothedParameter> filterSend;
+    float send[RENDER_BLOCK_SIZE];
     
     std::atomic<float>* afpShapeSet;
     OscShapeSet currentShapeSet = OscShapeSetNil;
@@ -70,7 +167,7 @@ private:
     float outSamples[2][NUM_STRINGS];
     
     File waveTableFile;
-    bool loadingTables = false;
+    AudioThreadHandoff<WaveTableSet> waveTables;
 };
 
 //==============================================================================
@@ -86,7 +183,7 @@ public:
     //==============================================================================
     void prepareToPlay (double sampleRate, int samplesPerBlock);
     void frame();
-    void tick();
+    void tick(int numSamples, uint32_t voices);
     
     //==============================================================================
     void noteOn(int voice, float velocity);
@@ -141,14 +238,20 @@ public:
     //==============================================================================
     void prepareToPlay (double sampleRate, int samplesPerBlock);
     void frame();
-    void tick(float output[][NUM_STRINGS]);
+    void beginBlock(int numSamples);
+    void tick(float output[][RENDER_BLOCK_SIZE][NUM_STRINGS], int numSamples, uint32_t voices);
+    void skip(int numSamples) { filterSend->skip(numSamples); }
+    
+    void seedRandom(uint32_t seed) { random.seed(seed); }
     
 private:
     
-    tNoise noise[NUM_STRINGS];
+    VoiceRandom random;
+    alignas(16) float whiteNoise[RENDER_BLOCK_SIZE][NUM_STRINGS];
     tSVF bandpass[NUM_STRINGS];
     
     std::unique_ptr<SmoothedParameter> filterSend;
+    float send[RENDER_BLOCK_SIZE];
     
     float* sourceValues[MAX_NUM_UNIQUE_SKEWS];
 };
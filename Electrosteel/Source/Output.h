@@ -12,7 +12,10 @@
 
 #include "Constants.h"
 #include "Utilities.h"
-#define MASTER_OVERSAMPLE 8
+#include "Oversampler.h"
+#define DEFAULT_MASTER_OVERSAMPLE 2
+// Used instead while the host is rendering offline
+#define OFFLINE_MASTER_OVERSAMPLE 8
 //==============================================================================
 
 class Output : public AudioComponent
@@ -25,12 +28,23 @@ public:
     //==============================================================================
     void prepareToPlay (double sampleRate, int samplesPerBlock);
     void frame();
-    void tick(float input[NUM_STRINGS], float output[2], int numChannels);
+    // Applies each voice's amp and pan to samples[1], leaving the left
+    // channel in samples[0] and the right in samples[1]
+    void tickVoices(float samples[][RENDER_BLOCK_SIZE][NUM_STRINGS], int numChannels,
+                    int numSamples, uint32_t voices);
+    // Mixes the voices tickVoices() has been called for down to output
+    void tick(float samples[][RENDER_BLOCK_SIZE][NUM_STRINGS], float output[][RENDER_BLOCK_SIZE],
+              int numChannels, int numSamples, uint32_t voices);
+    
+    // 1, 2, 4 or 8 times oversampling for the saturator
+    void setOversampling(int factor) { oversampler.setFactor(factor); }
+    int getOversampling() { return oversampler.getFactor(); }
+    // Antiderivative antialiasing for the saturator
+    void setAntiderivative(bool enabled) { oversampler.setAntiderivative(enabled); }
     
 private:
     
     std::unique_ptr<SmoothedParameter> master;
-    tOversampler os[2];
-    float oversamplerArray[MASTER_OVERSAMPLE];
+    StereoOversampler oversampler;
 };
 
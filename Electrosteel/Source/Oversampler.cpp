@@ -0,0 +1,229 @@
+/*
+  ==============================================================================
+
+    Oversampler.cpp
+
+  ==============================================================================
+*/
+
+#include "Oversampler.h"
+#include <utility>
+
+//==============================================================================
+static double besselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; ++k)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+void HalfBandStage::design(int taps)
+{
+    numTaps = taps < 1 ? 1 : (taps > MAX_HALF_BAND_TAPS ? MAX_HALF_BAND_TAPS : taps);
+    
+    // Kaiser window, beta 8 for around 80dB of stopband
+    const double pi = 3.14159265358979323846;
+    const double beta = 8.0;
+    const double halfLength = 2.0 * numTaps;
+    double h[MAX_HALF_BAND_TAPS];
+    double sum = 0.0;
+    for (int k = 0; k < numTaps; ++k)
+    {
+        double d = 2.0 * k + 1.0;
+        double r = d / halfLength;
+        double window = besselI0(beta * std::sqrt(1.0 - r * r)) / besselI0(beta);
+        h[k] = 0.5 * std::sin(0.5 * pi * d) / (0.5 * pi * d) * window;
+        sum += h[k];
+    }
+    // Both sides of the odd taps together should add up to the other half
+    // of the gain at DC, the centre tap being the first half
+    for (int k = 0; k < numTaps; ++k)
+    {
+        float c = (float) (h[k] * 0.25 / sum);
+        coeffs[k] = float4::broadcast(c);
+        upCoeffs[k] = float4::broadcast(2.f * c);
+    }
+    
+    reset();
+}
+
+void HalfBandStage::reset()
+{
+    const float4 zero = float4::broadcast(0.f);
+    for (int i = 0; i < historySize; ++i)
+    {
+        upInput[i] = zero;
+        downEven[i] = zero;
+        downOdd[i] = zero;
+    }
+}
+
+void HalfBandStage::upsample(const float4* in, float4* out, int numSamples)
+{
+    const int history = 2 * numTaps;
+    float4* x = upInput + history;
+    for (int i = 0; i < numSamples; ++i) x[i] = in[i];
+    
+    for (int i = 0; i < numSamples; ++i)
+    {
+        // The taps sit symmetrically around halfway between x[i-K] and x[i-K+1]
+        const float4* newer = x + i - numTaps + 1;
+        const float4* older = x + i - numTaps;
+        float4 sum = float4::broadcast(0.f);
+        for (int k = 0; k < numTaps; ++k)
+        {
+            sum = sum + upCoeffs[k] * (newer[k] + older[-k]);
+        }
+        out[2*i] = sum;
+        out[2*i+1] = newer[0];
+    }
+    
+    for (int i = 0; i < history; ++i) upInput[i] = upInput[numSamples + i];
+}
+
+void HalfBandStage::downsample(const float4* in, float4* out, int numSamples)
+{
+    const int history = 2 * numTaps;
+    float4* even = downEven + history;
+    float4* odd = downOdd + history;
+    for (int i = 0; i < numSamples; ++i)
+    {
+        even[i] = in[2*i];
+        odd[i] = in[2*i+1];
+    }
+    
+    const float4 centre = float4::broadcast(0.5f);
+    for (int i = 0; i < numSamples; ++i)
+    {
+        const float4* newer = even + i - numTaps + 1;
+        const float4* older = even + i - numTaps;
+        float4 sum = centre * odd[i - numTaps];
+        for (int k = 0; k < numTaps; ++k)
+        {
+            sum = sum + coeffs[k] * (newer[k] + older[-k]);
+        }
+        out[i] = sum;
+    }
+    
+    for (int i = 0; i < history; ++i)
+    {
+        downEven[i] = downEven[numSamples + i];
+        downOdd[i] = downOdd[numSamples + i];
+    }
+}
+
+//==============================================================================
+StereoOversampler::StereoOversampler()
+{
+    // The first stage has to cut off right above the audio band; after that
+    // there's more and more room for the transition
+    const int taps[MAX_OVERSAMPLE_STAGES] = { MAX_HALF_BAND_TAPS, 8, 4 };
+    for (int i = 0; i < MAX_OVERSAMPLE_STAGES; ++i) stages[i].design(taps[i]);
+    setFactor(1);
+}
+
+void StereoOversampler::setFactor(int factor)
+{
+    int n = 0;
+    while (n < MAX_OVERSAMPLE_STAGES && (2 << n) <= factor) n++;
+    if (n == numStages) return;
+    numStages = n;
+    reset();
+}
+
+void StereoOversampler::setAntiderivative(bool shouldUseAntiderivative)
+{
+    if (antiderivative == shouldUseAntiderivative) return;
+    antiderivative = shouldUseAntiderivative;
+    reset();
+}
+
+void StereoOversampler::reset()
+{
+    for (int i = 0; i < MAX_OVERSAMPLE_STAGES; ++i) stages[i].reset();
+    lastInput = float4::broadcast(0.f);
+    lastLogCosh = float4::broadcast(0.f);
+}
+
+// log(cosh(x)) + log(2), written so nothing overflows: |x| + log(1 + e^-2|x|).
+// The first term is exact, so differences between nearby values only carry
+// the error of the small second term
+static inline float4 logCoshPlusLog2(float4 x)
+{
+    using namespace fastmath;
+    const float4 ln2 = float4::broadcast(0.6931471806f);
+    float4 a = vabs(x);
+    float4 e = fastExp2(a * float4::broadcast(-2.f * log2e));
+    return a + ln2 * fastLog2(float4::broadcast(1.f) + e);
+}
+
+void StereoOversampler::antiderivativeTanh(float4* samples, int numSamples)
+{
+    // Below this step the quotient loses too much to cancellation, and tanh
+    // of the midpoint is within 1e-4 of the average anyway
+    const float4 minStep = float4::broadcast(1e-3f);
+    const float4 half = float4::broadcast(0.5f);
+    
+    float4 x0 = lastInput;
+    float4 f0 = lastLogCosh;
+    for (int s = 0; s < numSamples; ++s)
+    {
+        float4 x1 = samples[s];
+        float4 f1 = logCoshPlusLog2(x1);
+        float4 step = x1 - x0;
+        float4 small = cmplt(vabs(step), minStep);
+        // Keep the division away from zero in the lanes that don't use it
+        float4 safeStep = select(small, float4::broadcast(1.f), step);
+        float4 average = (f1 - f0) / safeStep;
+        samples[s] = select(small, fastTanh(half * (x0 + x1)), average);
+        x0 = x1;
+        f0 = f1;
+    }
+    lastInput = x0;
+    lastLogCosh = f0;
+}
+
+void StereoOversampler::processTanh(float* left, float* right, int numSamples)
+{
+    float4* in = buffers[0];
+    float4* out = buffers[1];
+    
+    // Left and right in the first two lanes
+    alignas(16) float lanes[SIMD_WIDTH] = { 0.f, 0.f, 0.f, 0.f };
+    for (int s = 0; s < numSamples; ++s)
+    {
+        lanes[0] = left[s];
+        lanes[1] = right[s];
+        in[s] = float4::load(lanes);
+    }
+    
+    int n = numSamples;
+    const int stagesInUse = numStages;
+    for (int i = 0; i < stagesInUse; ++i)
+    {
+        stages[i].upsample(in, out, n);
+        std::swap(in, out);
+        n *= 2;
+    }
+    
+    if (antiderivative) antiderivativeTanh(in, n);
+    else for (int s = 0; s < n; ++s) in[s] = fastTanh(in[s]);
+    
+    for (int i = stagesInUse - 1; i >= 0; --i)
+    {
+        n /= 2;
+        stages[i].downsample(in, out, n);
+        std::swap(in, out);
+    }
+    
+    for (int s = 0; s < numSamples; ++s)
+    {
+        in[s].store(lanes);
+        left[s] = lanes[0];
+        right[s] = lanes[1];
+    }
+}
@@ -0,0 +1,99 @@
+/*
+  ==============================================================================
+
+    Oversampler.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Constants.h"
+#include "SIMD.h"
+#include "FastMath.h"
+
+// Number of 2x stages at the highest factor, 8x
+#define MAX_OVERSAMPLE_STAGES 3
+// Nonzero taps either side of the centre of the steepest half band filter
+#define MAX_HALF_BAND_TAPS 24
+
+//==============================================================================
+// One 2x step up and back down through the same half band lowpass, a whole
+// block at a time. Half of a half band filter's taps are zero, apart from
+// the centre, so going up the odd outputs are just delayed input and going
+// down the odd inputs only meet the centre tap.
+class HalfBandStage
+{
+public:
+    //==============================================================================
+    HalfBandStage() = default;
+    
+    // Windowed sinc with numTaps nonzero taps each side of the centre;
+    // fewer taps gives a wider transition band
+    void design(int numTaps);
+    void reset();
+    
+    // out gets 2 * numSamples samples
+    void upsample(const float4* in, float4* out, int numSamples);
+    // in has 2 * numSamples samples
+    void downsample(const float4* in, float4* out, int numSamples);
+    
+private:
+    static const int maxBlockSize = RENDER_BLOCK_SIZE << (MAX_OVERSAMPLE_STAGES - 1);
+    static const int historySize = 2 * MAX_HALF_BAND_TAPS;
+    
+    int numTaps = 0;
+    // Taps at 1, 3, 5... samples either side of the centre, and those doubled
+    // to make up for the zeros stuffed in when upsampling
+    float4 coeffs[MAX_HALF_BAND_TAPS];
+    float4 upCoeffs[MAX_HALF_BAND_TAPS];
+    
+    // Each holds 2 * numTaps samples of history followed by the block
+    float4 upInput[historySize + maxBlockSize];
+    float4 downEven[historySize + maxBlockSize];
+    float4 downOdd[historySize + maxBlockSize];
+};
+
+//==============================================================================
+// Runs left and right through a waveshaper at 1, 2, 4 or 8 times the sample
+// rate, both channels together in one vector. Each 2x stage needs less
+// filtering than the one before since there's more room above the audio
+// band, so the cascade is much cheaper than one long filter.
+//
+// With antiderivative antialiasing on, the shaper outputs the average of tanh
+// over the straight line between consecutive inputs, worked out from its
+// antiderivative log(cosh(x)). That acts like a lowpass on the harmonics tanh
+// creates before they can alias, at the cost of half a sample of delay and a
+// high end rolloff of cos(pi f / oversampled rate): at 48kHz, 20kHz drops
+// 2dB at 2x, 0.5dB at 4x and 0.1dB at 8x. Measured on a driven sine, 2x with
+// it beats 2x without by 20 to 25dB, and 4x with it is about as clean as 8x
+// without. ESBenchmark --saturator checks both.
+class StereoOversampler
+{
+public:
+    //==============================================================================
+    StereoOversampler();
+    
+    // factor is rounded down to a power of two in [1, 8]
+    void setFactor(int factor);
+    int getFactor() { return 1 << numStages; }
+    void reset();
+    
+    void setAntiderivative(bool shouldUseAntiderivative);
+    bool getAntiderivative() { return antiderivative; }
+    
+    // In place, for up to RENDER_BLOCK_SIZE samples
+    void processTanh(float* left, float* right, int numSamples);
+    
+private:
+    void antiderivativeTanh(float4* samples, int numSamples);
+    
+    HalfBandStage stages[MAX_OVERSAMPLE_STAGES];
+    int numStages = 0;
+    
+    bool antiderivative = false;
+    float4 lastInput;
+    float4 lastLogCosh;
+    
+    float4 buffers[2][RENDER_BLOCK_SIZE << MAX_OVERSAMPLE_STAGES];
+};
@@ -8,7 +8,6 @@
  ==============================================================================
  */
 
-#include "ESStandalone.h"
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
@@ -278,9 +277,10 @@ ESAudioProcessor::ESAudioProcessor()
 ,
 vts(*this, nullptr, juce::Identifier ("Parameters"), createParameterLayout())
 {
-    formatManager.registerBasicFormats();   
     keyboardState.addListener(this);
     
+    // Nothing rendered draws from leaf.random; noise and random on attack
+    // have their own per string generators (see VoiceRandom)
     LEAF_init(&leaf, 44100.0f, dummy_memory, 1, []() {return (float)rand() / RAND_MAX; });
     
     leaf.clearOnAllocation = 1;
@@ -289,11 +289,12 @@ vts(*this, nullptr, juce::Identifier ("Parameters"), createParameterLayout())
     tSimplePoly_setNumVoices(&strings[0], 1);
     
     voiceNote[0] = 0;
+    voiceSilentSamples[0] = 0;
     for (int i = 1; i < NUM_STRINGS; ++i)
     {
         tSimplePoly_init(&strings[i], 1, &leaf);
         voiceNote[i] = 0;
-        voiceIsSounding[i] = false;
+        voiceSilentSamples[i] = 0;
     }
     
     for (int i = 0; i < NUM_STRINGS; ++i)
@@ -340,7 +341,8 @@ vts(*this, nullptr, juce::Identifier ("Parameters"), createParameterLayout())
         }
         
         ccParams.add(new SmoothedParameter(*this, vts, n));
-        ccSources.add(new MappingSourceModel(*this, n, false, false, c));
+        ccSources.add(new MappingSourceModel(*this, n, false, true, false, c));
+        ccParams.getLast()->setSkewSource(ccSources.getLast());
         for (int j = 0; j < invParameterSkews.size(); ++j)
         {
             float** source = ccParams.getLast()->getValuePointerArray(j);
@@ -355,11 +357,11 @@ vts(*this, nullptr, juce::Identifier ("Parameters"), createParameterLayout())
     }
     
     midiKeySource = std::make_unique<MappingSourceModel>(*this, "MIDI Key In",
-                                                         true, false, Colours::white);
+                                                         true, false, false, Colours::white);
 	velocitySource = std::make_unique<MappingSourceModel>(*this, "Velocity In",
-														  true, false, Colours::white);
+														  true, false, false, Colours::white);
 	randomSource = std::make_unique<MappingSourceModel>(*this, "Random on Attack",
-                                                        true, false, Colours::white);
+                                                        true, false, false, Colours::white);
     for (int i = 0; i < numInvParameterSkews; ++i)
     {
         midiKeyValues[i] = (float*)leaf_alloc(&leaf, sizeof(float) * NUM_STRINGS);
@@ -445,15 +447,12 @@ vts(*this, nullptr, juce::Identifier ("Parameters"), createParameterLayout())
 
 ESAudioProcessor::~ESAudioProcessor()
 {
-    DBG("Pre exit: " + String(leaf.allocCount) + " " + String(leaf.freeCount));
+    renderThreads.setNumThreads(1);
     
-    for (auto waveTableSet : waveTables)
-    {
-        for (auto waveTable : waveTableSet)
-        {
-            tWaveTableS_free(&waveTable);
-        }
-    }
+    waveTableLoader.stop();
+    sysexSender.stop();
+    
+    DBG("Pre exit: " + String(leaf.allocCount) + " " + String(leaf.freeCount));
     
     for (int i = 0; i < NUM_STRINGS; ++i)
     {
@@ -474,18 +473,17 @@ ESAudioProcessor::~ESAudioProcessor()
 void ESAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
     stringActivityTimeout = sampleRate/samplesPerBlock/2;
+    voiceSilenceTimeout = (int)(sampleRate * VOICE_SILENCE_TIMEOUT_MS * 0.001);
+    profiler.prepareToPlay(sampleRate);
+    sysexSender.prepareToPlay(sampleRate);
+    
+    // Workers are only started or stopped here and from the message thread,
+    // never from processBlock
+    renderThreads.setNumThreads(isNonRealtime() ? MAX_RENDER_THREADS : numRenderThreads);
     LEAF_setSampleRate(&leaf, sampleRate);
     
     DBG("Pre prepare: " + String(leaf.allocCount) + " " + String(leaf.freeCount));
     
-    for (auto waveTableSet : waveTables)
-    {
-        for (auto waveTable : waveTableSet)
-        {
-            tWaveTableS_setSampleRate(&waveTable, sampleRate);
-        }
-    }
-    
     for (auto env : envs)
     {
         env->prepareToPlay(sampleRate, samplesPerBlock);
@@ -519,6 +517,10 @@ void ESAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
         initialMappings.clear();
     }
     
+    // Hosts usually go offline before preparing for a bounce, so processBlock
+    // never sees the switch, and every bounce should start from the seed
+    if (isNonRealtime() && offlineRandomSeed != 0) setRandomSeed(offlineRandomSeed);
+    
     DBG("Post prepare: " + String(leaf.allocCount) + " " + String(leaf.freeCount));
 }
 
@@ -554,170 +556,52 @@ bool ESAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
 }
 #endif
 
-union uintfUnion
-{
-    float f;
-    uint32_t i;
-};
-
 void ESAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
+    ES_PROFILE_BEGIN_BLOCK(profiler);
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
     
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
     buffer.clear (i, 0, buffer.getNumSamples());
     
+    if (isNonRealtime() != offlineRender) setOfflineRender(isNonRealtime());
+    output->setOversampling(offlineRender ? OFFLINE_MASTER_OVERSAMPLE : liveOversampling);
+    output->setAntiderivative(!offlineRender && liveAntiderivative);
+    
     MidiMessage m;
     for (MidiMessageMetadata metadata : midiMessages) {
         m = metadata.getMessage();
         handleMidiMessage(m);
     }
+    ES_PROFILE_LAP(profiler, 0, ProfileMidi);
     
-    if (waitingToSendPreset)
-    {
-        Array<float> data;
-        
-        // Parameter values
-        // Order is determined in createParameterLayout
-        for (auto id : paramIds)
-        {
-            const NormalisableRange<float>& range = vts.getParameter(id)->getNormalisableRange();
-            data.add(range.convertFrom0to1(vts.getParameter(id)->getValue()));
-        }
-        
-        // Mappings
-        for (auto id : paramIds)
-        {
-            for (int t = 0; t < 3; ++t)
-            {
-                String tn = id + " T" + String(t+1);
-                if (targetMap.contains(tn))
-                {
-                    MappingTargetModel* target = targetMap[tn];
-                    if (MappingSourceModel* source = target->currentSource)
-                    {
-                        data.add(sourceIds.indexOf(source->name));//SourceID
-                        data.add(paramIds.indexOf(target->name));//TargetID
-                        data.add(t);//TargetIndex
-                        data.add(target->end);//Mapping range length
-                    }
-                }
-            }
-        }
-        
-        Array<uint8_t> data7bitInt;
-        union uintfUnion fu;
-        
-        for (int i = 0; i < data.size(); i++)
-        {
-            data7bitInt.add(0); // saying it's a preset
-            
-            fu.f = data[i];
-            data7bitInt.add((fu.i >> 28) & 15);
-            data7bitInt.add((fu.i >> 21) & 127);
-            data7bitInt.add((fu.i >> 14) & 127);
-            data7bitInt.add((fu.i >> 7) & 127);
-            data7bitInt.add(fu.i & 127);
-            
-            MidiMessage presetMessage = MidiMessage::createSysExMessage(data7bitInt.getRawDataPointer(), sizeof(uint8_t) * data7bitInt.size());
-            
-            midiMessages.addEvent(presetMessage, 0);
-        }
-        
-        // Wavetable data
-        
-        // Determine which tables are in use and therefore should be sent
-        Array<String> tableSetsToSend;
-        for (auto osc : oscs)
-        {
-            if (osc->getCurrentShapeSet() == UserOscShapeSet)
-            {
-                tableSetsToSend.addIfNotAlreadyThere(osc->getWaveTableFile().getFullPathName());
-            }
-        }
-        
-        // Send out each set of tables
-        for (auto setName : tableSetsToSend)
-        {
-            data.clear();
-            data7bitInt.clear();
-            
-            for (auto table : waveTables.getReference(setName))
-            {
-                for (int i = 0; i < table->numTables; ++i)
-                {
-                    data.add(table->sizes[i]);
-                    for (int j = 0; j < table->sizes[i]; ++j)
-                    {
-                        data.add(table->tables[i][j]);
-                    }
-                }
-            }
-            
-            for (int i = 0; i < data.size(); i++)
-            {
-                data7bitInt.add(2); // saying it's wavetable data
-                
-                fu.f = data[i];
-                data7bitInt.add((fu.i >> 28) & 15);
-                data7bitInt.add((fu.i >> 21) & 127);
-                data7bitInt.add((fu.i >> 14) & 127);
-                data7bitInt.add((fu.i >> 7) & 127);
-                data7bitInt.add(fu.i & 127);
-                
-                MidiMessage presetMessage = MidiMessage::createSysExMessage(data7bitInt.getRawDataPointer(), sizeof(uint8_t) * data7bitInt.size());
-                
-                midiMessages.addEvent(presetMessage, 0);
-            }
-        }
-    
-        waitingToSendPreset = false;
-    }
+    // Only ever copies out what's already encoded
+    sysexSender.renderNextBlock(midiMessages, buffer.getNumSamples());
+    ES_PROFILE_LAP(profiler, 0, ProfileSysex);
     
-    if (waitingToSendCopedent)
+    // Idle with nothing to render: only keep the smoothed parameters moving
+    // so nothing ramps from a stale value later. Any note on in this buffer
+    // has been handled above and made its voice active, so it wakes the
+    // engine in time for its first sample
+    if (engineIdle && getActiveVoices() == 0)
     {
-        Array<float> flat;
-    
-        for (int i = 0; i < copedentArray.size(); ++i)
-        {
-            for (auto value : copedentArray.getReference(i))
-            {
-                flat.add(value);
-            }
-        }
-
-        //RangedAudioParameter* fund = vts.getParameter("Copedent Fundamental");
-        //flat.add(fund->convertFrom0to1(fund->getValue()));
+        int numSamples = buffer.getNumSamples();
+        for (auto p : ccParams) p->skip(numSamples);
+        for (auto o : oscs) o->skip(numSamples);
+        noise->skip(numSamples);
         
-        Array<uint8_t> flat7bitInt;
-        union uintfUnion fu;
+        buffer.clear();
         
-        for (int j = 0; j < 11; j++)
-        {
-            flat7bitInt.clear();
-            
-            flat7bitInt.add(1); // saying it's a copedent
-            flat7bitInt.add(copedentNumber); // saying which copedent number to store (need this to be a user entered value)
-            flat7bitInt.add(50 + j);
-            
-            for (int i = 0; i < 12; i++)
-            {
-                fu.f = flat[i + (j*12)];
-                flat7bitInt.add((fu.i >> 28) & 15);
-                flat7bitInt.add((fu.i >> 21) & 127);
-                flat7bitInt.add((fu.i >> 14) & 127);
-                flat7bitInt.add((fu.i >> 7) & 127);
-                flat7bitInt.add(fu.i & 127);
-            }
-            
-            MidiMessage copedentMessage = MidiMessage::createSysExMessage(flat7bitInt.getRawDataPointer(), sizeof(uint8_t) * flat7bitInt.size());
-            
-            midiMessages.addEvent(copedentMessage, 0);
-        }
-        waitingToSendCopedent = false;
+        for (int i = 0; i < NUM_CHANNELS; ++i)
+            if (stringActivity[i] > 0) stringActivity[i]--;
+        
+        ES_PROFILE_LAP(profiler, 0, ProfileParameters);
+        ES_PROFILE_END_BLOCK(profiler, numSamples);
+        return;
     }
+    engineIdle = false;
     
     Array<float> resolvedCopedent;
     for (int r = 0; r < NUM_STRINGS; ++r)
@@ -754,36 +638,35 @@ void ESAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer& mid
         filt[i]->frame();
     }
     output->frame();
+    ES_PROFILE_LAP(profiler, 0, ProfileFrame);
     
     int mpe = mpeMode ? 1 : 0;
     int impe = 1-mpe;
     
-    for (int s = 0; s < buffer.getNumSamples(); s++)
+    // Render in chunks of up to RENDER_BLOCK_SIZE samples, with each component
+    // processing the whole chunk for every voice before the next one runs.
+    // All MIDI for this buffer has already been handled above, so the
+    // unsmoothed per-note values only need to be resolved once per chunk.
+    float samples[2][RENDER_BLOCK_SIZE][NUM_STRINGS];
+    float outputSamples[2][RENDER_BLOCK_SIZE];
+    
+    for (int offset = 0; offset < buffer.getNumSamples(); offset += RENDER_BLOCK_SIZE)
     {
+        int numSamples = jmin(RENDER_BLOCK_SIZE, buffer.getNumSamples() - offset);
+        
 		float parallel = seriesParallelParam->tickNoHooksNoSmoothing();
 		float transp = transposeParam->tickNoHooksNoSmoothing();
-
-        for (int i = 0; i < ccParams.size(); ++i)
+        
+        for (int s = 0; s < numSamples; ++s)
         {
-            ccParams[i]->tickSkewsNoHooks();
+            for (int i = 0; i < ccParams.size(); ++i)
+            {
+                ccParams[i]->tickSkewsNoHooks(s);
+            }
         }
         
         float globalPitchBend = pitchBendParams[0]->tickNoHooksNoSmoothing();
         
-        float samples[2][NUM_STRINGS];
-        float outputSamples[2];
-        outputSamples[0] = 0.f;
-        outputSamples[1] = 0.f;
-        
-        for (int i = 0; i < envs.size(); ++i)
-        {
-            envs[i]->tick();
-        }
-        for (int i = 0; i < lfos.size(); ++i)
-        {
-            lfos[i]->tick();
-        }
-        
         for (int v = 0; v < numVoicesActive; ++v)
         {
             float pitchBend = transp + globalPitchBend + pitchBendParams[v+1]->tickNoHooksNoSmoothing();
@@ -804,41 +687,79 @@ void ESAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer& mid
             //float tunedNote = tempNote + centsDeviation[(int)tempPitchClass];
             //voiceNote[v] = tunedNote;
             voiceNote[v] = tempNote;
-            
-            samples[0][v] = 0.f;
-            samples[1][v] = 0.f;
         }
         
-        for (int i = 0; i < oscs.size(); ++i)
+        for (int s = 0; s < numSamples; ++s)
         {
-            oscs[i]->tick(samples);
+            for (int v = 0; v < NUM_STRINGS; ++v)
+            {
+                samples[0][s][v] = 0.f;
+                samples[1][s][v] = 0.f;
+            }
         }
-        noise->tick(samples);
-
-        filt[0]->tick(samples[0]);
         
-        for (int v = 0; v < numVoicesActive; ++v)
+        for (int i = 0; i < oscs.size(); ++i)
         {
-            samples[1][v] += samples[0][v]*(1.f-parallel);
+            oscs[i]->beginBlock(numSamples);
         }
+        noise->beginBlock(numSamples);
         
-        filt[1]->tick(samples[1]);
+        // Every voice only reads its own modulation and audio, so groups of
+        // strings can be rendered on separate threads. Only the sounding
+        // groups are shared out, and short chunks aren't worth handing off
+        uint32_t activeVoices = getActiveVoices();
         
-        for (int v = 0; v < numVoicesActive; ++v)
+        VoiceRender render;
+        render.processor = this;
+        render.samples = samples;
+        render.numSamples = numSamples;
+        render.numChannels = totalNumOutputChannels;
+        render.parallel = parallel;
+        
+        int numPartitions = numSamples < MIN_THREADED_RENDER_SAMPLES ? 1 :
+        offlineRender ? renderThreads.getNumThreads() :
+        jmin(numRenderThreads, renderThreads.getNumThreads());
+        int numGroups = 0;
+        for (int p = 0; p < MAX_RENDER_THREADS; ++p) render.voices[p] = 0;
+        for (int v = 0; v < NUM_STRINGS; v += SIMD_WIDTH)
         {
-            samples[1][v] += samples[0][v]*parallel;
+            uint32_t group = activeVoices & (((1u << SIMD_WIDTH) - 1u) << v);
+            if (group) render.voices[numGroups++ % numPartitions] |= group;
         }
         
-        output->tick(samples[1], outputSamples, totalNumOutputChannels);
-    
+        ES_PROFILE_LAP(profiler, 0, ProfileParameters);
+        renderThreads.run(&renderVoicesJob, &render, jmin(numGroups, numPartitions));
+        // Waiting on the workers only shows up in the block total
+        ES_PROFILE_START(profiler, 0);
+        
+        retireFinishedVoices(samples, numSamples);
+        
+        output->tick(samples, outputSamples, totalNumOutputChannels, numSamples, activeVoices);
+        
         for (int channel = 0; channel < totalNumOutputChannels; ++channel)
         {
-            buffer.setSample(channel, s, outputSamples[channel]);
+            buffer.copyFrom(channel, offset, outputSamples[channel], numSamples);
         }
+        
+        if (getActiveVoices() == 0)
+        {
+            float peak = 0.f;
+            for (int channel = 0; channel < totalNumOutputChannels; ++channel)
+            {
+                for (int s = 0; s < numSamples; ++s)
+                {
+                    peak = jmax(peak, fabsf(outputSamples[channel][s]));
+                }
+            }
+            engineIdle = peak < ENGINE_IDLE_THRESHOLD;
+        }
+        ES_PROFILE_LAP(profiler, 0, ProfileOutput);
     }
     
     for (int i = 0; i < NUM_CHANNELS; ++i)
         if (stringActivity[i] > 0) stringActivity[i]--;
+    
+    ES_PROFILE_END_BLOCK(profiler, buffer.getNumSamples());
 }
 
 //==============================================================================
@@ -870,6 +791,10 @@ void ESAudioProcessor::handleMidiMessage(const MidiMessage& m)
     {
         keyboardState.processNextMidiEvent(m);
     }
+    else if (m.isSysEx())
+    {
+        hardwareSync.handleSysex(m.getSysExData(), m.getSysExDataSize());
+    }
     else
     {
         int channel = m.getChannel();
@@ -900,16 +825,18 @@ void ESAudioProcessor::noteOn(int channel, int key, float velocity)
             float norm = key / float(midiKeyMax - midiKeyMin);
             midiKeyValues[0][i] = jlimit(0.f, 1.f, norm);
             velocityValues[0][i] = velocity;
-            float r = leaf.random();
+            float r = attackRandom.next(i);
             randomValues[0][i] = r;
             lastRandomValue = r;
             for (int s = 1; s < numInvParameterSkews; ++s)
             {
                 float invSkew = quickInvParameterSkews[s];
-                midiKeyValues[s][i] = powf(norm, invSkew);
-                velocityValues[s][i] = powf(velocity, invSkew);
-                randomValues[s][i] = powf(r, invSkew);
+                midiKeyValues[s][i] = fastPow(norm, invSkew);
+                velocityValues[s][i] = fastPow(velocity, invSkew);
+                randomValues[s][i] = fastPow(r, invSkew);
             }
+            setVoiceSounding(i, true);
+            voiceSilentSamples[i] = 0;
             for (auto e : envs) e->noteOn(i, velocity);
             for (auto o : lfos) o->noteOn(i, velocity);
         }
@@ -1032,15 +959,254 @@ void ESAudioProcessor::setNumVoicesActive(int numVoices)
     setMPEMode(mpeMode);
 }
 
+//==============================================================================
+void ESAudioProcessor::renderVoicesJob(void* context, int partition)
+{
+    VoiceRender* render = (VoiceRender*)context;
+    render->processor->renderVoices(render->samples, render->numSamples, render->numChannels,
+                                    render->parallel, render->voices[partition], partition);
+}
+
+void ESAudioProcessor::renderVoices(float samples[][RENDER_BLOCK_SIZE][NUM_STRINGS], int numSamples,
+                                    int numChannels, float parallel, uint32_t voices,
+                                    int partition)
+{
+    ES_PROFILE_START(profiler, partition);
+    
+    for (int i = 0; i < envs.size(); ++i)
+    {
+        envs[i]->tick(numSamples, voices);
+    }
+    ES_PROFILE_LAP(profiler, partition, ProfileEnvelopes);
+    for (int i = 0; i < lfos.size(); ++i)
+    {
+        lfos[i]->tick(numSamples, voices);
+    }
+    ES_PROFILE_LAP(profiler, partition, ProfileLFOs);
+    
+    for (int i = 0; i < oscs.size(); ++i)
+    {
+        oscs[i]->tick(samples, numSamples, voices);
+    }
+    ES_PROFILE_LAP(profiler, partition, ProfileOscillators);
+    noise->tick(samples, numSamples, voices);
+    ES_PROFILE_LAP(profiler, partition, ProfileNoise);
+    
+    filt[0]->tick(samples[0], numSamples, voices);
+    
+    for (int s = 0; s < numSamples; ++s)
+    {
+        for (uint32_t m = voices; m; m &= m - 1)
+        {
+            int v = lowestVoice(m);
+            samples[1][s][v] += samples[0][s][v]*(1.f-parallel);
+        }
+    }
+    
+    filt[1]->tick(samples[1], numSamples, voices);
+    ES_PROFILE_LAP(profiler, partition, ProfileFilters);
+    
+    for (int s = 0; s < numSamples; ++s)
+    {
+        for (uint32_t m = voices; m; m &= m - 1)
+        {
+            int v = lowestVoice(m);
+            samples[1][s][v] += samples[0][s][v]*parallel;
+        }
+    }
+    
+    output->tickVoices(samples, numChannels, numSamples, voices);
+    ES_PROFILE_LAP(profiler, partition, ProfileOutput);
+}
+
+void ESAudioProcessor::retireFinishedVoices(float samples[][RENDER_BLOCK_SIZE][NUM_STRINGS],
+                                            int numSamples)
+{
+    int mpe = mpeMode ? 1 : 0;
+    int impe = 1-mpe;
+    
+    for (uint32_t m = getActiveVoices(); m; m &= m - 1)
+    {
+        int v = lowestVoice(m);
+        
+        // Held notes are never retired
+        if (tSimplePoly_isOn(&strings[v*mpe], v*impe))
+        {
+            voiceSilentSamples[v] = 0;
+            continue;
+        }
+        
+        float peak = 0.f;
+        for (int s = 0; s < numSamples; ++s)
+        {
+            peak = jmax(peak, fabsf(samples[0][s][v]), fabsf(samples[1][s][v]));
+        }
+        if (peak > VOICE_SILENCE_THRESHOLD) voiceSilentSamples[v] = 0;
+        else voiceSilentSamples[v] += numSamples;
+        
+        // A released voice is finished once every envelope in use has
+        // finished its release, or once it's been quiet for long enough
+        int numEnvsInUse = 0;
+        int numEnvsIdle = 0;
+        for (auto e : envs)
+        {
+            if (!e->isInUse()) continue;
+            numEnvsInUse++;
+            if (e->isIdle(v)) numEnvsIdle++;
+        }
+        
+        if ((numEnvsInUse > 0 && numEnvsIdle == numEnvsInUse) ||
+            voiceSilentSamples[v] >= voiceSilenceTimeout)
+        {
+            retireVoice(v);
+        }
+    }
+}
+
+void ESAudioProcessor::retireVoice(int voice)
+{
+    int mpe = mpeMode ? 1 : 0;
+    int impe = 1-mpe;
+    
+    tSimplePoly_deactivateVoice(&strings[voice*mpe], voice*impe);
+    setVoiceSounding(voice, false);
+    voiceSilentSamples[voice] = 0;
+    
+    for (auto f : filt) f->retireVoice(voice);
+}
+
+void ESAudioProcessor::setNumRenderThreads(int numThreads)
+{
+    // Workers can't be started or stopped while a block is rendering
+    numRenderThreads = jlimit(1, MAX_RENDER_THREADS, numThreads);
+    int poolThreads = offlineRender ? MAX_RENDER_THREADS : numRenderThreads;
+    if (poolThreads == renderThreads.getNumThreads()) return;
+    suspendProcessing(true);
+    renderThreads.setNumThreads(poolThreads);
+    suspendProcessing(false);
+}
+
+void ESAudioProcessor::setOfflineRender(bool offline)
+{
+    // Called from processBlock when the host switches modes, so it mustn't
+    // start or stop threads. Offline renders use every worker prepareToPlay
+    // started, which is all of them if the host went offline before
+    // preparing, as hosts do for a bounce. Live blocks only use
+    // numRenderThreads of them and the rest sleep
+    offlineRender = offline;
+    if (offline && offlineRandomSeed != 0) setRandomSeed(offlineRandomSeed);
+    
+    // Modulation at audio rate everywhere
+    int interval = offline ? 1 : controlRateInterval;
+    controlRateMask = interval - 1;
+    invControlRateInterval = 1.f / interval;
+}
+
+void ESAudioProcessor::setRandomSeed(uint32_t seed)
+{
+    attackRandom.seed(seed);
+    // A different stream for each user of the seed
+    noise->seedRandom(seed ^ 0x5bd1e995u);
+}
+
+void ESAudioProcessor::setOversampling(int factor)
+{
+    // Picked up by the next processBlock
+    liveOversampling = factor >= 8 ? 8 : factor >= 4 ? 4 : factor >= 2 ? 2 : 1;
+}
+
+void ESAudioProcessor::setControlRateInterval(int interval)
+{
+    // Round down to a power of two so control ticks can be found with a mask
+    interval = jlimit(1, RENDER_BLOCK_SIZE, interval);
+    int pow2 = 1;
+    while (pow2 * 2 <= interval) pow2 *= 2;
+    
+    controlRateInterval = pow2;
+    if (offlineRender) return;
+    controlRateMask = pow2 - 1;
+    invControlRateInterval = 1.f / pow2;
+}
+
 //==============================================================================
 void ESAudioProcessor::sendCopedentMidiMessage()
 {
-    waitingToSendCopedent = true;
+    HardwareState state;
+    captureHardwareState(state);
+    
+    //RangedAudioParameter* fund = vts.getParameter("Copedent Fundamental");
+    //state.copedent.add(fund->convertFrom0to1(fund->getValue()));
+    
+    sysexSender.sendCopedent(state.copedent, state.copedentNumber);
 }
 
 void ESAudioProcessor::sendPresetMidiMessage()
 {
-    waitingToSendPreset = true;
+    HardwareState state;
+    captureHardwareState(state);
+    
+    Array<float> data (state.parameters);
+    
+    // Mappings
+    for (int i = 0; i < state.mappingSources.size(); ++i)
+    {
+        if (state.mappingSources[i] < 0) continue;
+        int t = i % 3;
+        MappingTargetModel* target = targetMap[paramIds[i / 3] + " T" + String(t+1)];
+        data.add(state.mappingSources[i]);//SourceID
+        data.add(paramIds.indexOf(target->name));//TargetID
+        data.add(t);//TargetIndex
+        data.add(state.mappingEnds[i]);//Mapping range length
+    }
+    
+    // Wavetable data, each set in use sent once
+    Array<WaveTableData::Ptr> tables;
+    for (auto& table : state.tables)
+    {
+        if (table != nullptr) tables.addIfNotAlreadyThere(table);
+    }
+    
+    sysexSender.sendPreset(data, tables);
+}
+
+void ESAudioProcessor::captureHardwareState(HardwareState& state)
+{
+    // Parameter values
+    // Order is determined in createParameterLayout
+    for (auto id : paramIds)
+    {
+        const NormalisableRange<float>& range = vts.getParameter(id)->getNormalisableRange();
+        state.parameters.add(range.convertFrom0to1(vts.getParameter(id)->getValue()));
+    }
+    
+    // Mappings
+    for (auto id : paramIds)
+    {
+        for (int t = 0; t < 3; ++t)
+        {
+            String tn = id + " T" + String(t+1);
+            MappingTargetModel* target = targetMap.contains(tn) ? targetMap[tn] : nullptr;
+            MappingSourceModel* source = target != nullptr ? target->currentSource : nullptr;
+            state.mappingSources.add(source != nullptr ? sourceIds.indexOf(source->name) : -1);
+            state.mappingEnds.add(source != nullptr ? target->end : 0.f);
+        }
+    }
+    
+    state.copedentNumber = copedentNumber;
+    for (int i = 0; i < copedentArray.size(); ++i)
+    {
+        for (auto value : copedentArray.getReference(i))
+        {
+            state.copedent.add(value);
+        }
+    }
+    
+    // Only tables that have been loaded, not anything still loading
+    for (auto osc : oscs)
+    {
+        state.tables.add(osc->getShapeSetParameter() == UserOscShapeSet ?
+                         waveTableLoader.getLoadedData(*osc) : nullptr);
+    }
 }
 
 //==============================================================================
@@ -1126,81 +1292,6 @@ MappingTargetModel* ESAudioProcessor::getMappingTarget(const String& name)
     return targetMap.getReference(name);
 }
 
-//==============================================================================
-File ESAudioProcessor::loadWaveTables(const String& setName, File& file)
-{
-    // If we've already loaded this file, just return it
-    if (waveTableFiles.contains(file)) return file;
-    
-    // If this is the root of the wavetable set, keep track of the file
-    if (setName == file.getFullPathName()) waveTableFiles.add(file);
-//    {
-//        waveTableFiles.addIfNotAlreadyThere(file);
-//        // And if we've already loaded this, make sure to remove any existing redundant set
-//        if (waveTables.contains(setName))
-//        {
-//            for (auto waveTable : waveTables.getReference(setName))
-//            {
-//                tWaveTableS_free(&waveTable);
-//            }
-//            waveTables.remove(setName);
-//        }
-//    }
-    
-    // If we have a directory, add all .wav files in that dir to one wavetable set
-    if (file.isDirectory())
-    {
-        for (auto wav : file.findChildFiles(File::TypesOfFileToFind::findFiles, false, "*.wav"))
-        {
-            loadWaveTables(setName, wav);
-        }
-    }
-    // Read the file, generate a tWaveTableS, and add it to the wavetable set with setName
-    else
-    {
-        auto* reader = formatManager.createReaderFor(file);
-        
-        Array<AudioBuffer<float>> tableBuffers;
-        
-        if (reader != nullptr)
-        {
-            std::unique_ptr<juce::AudioFormatReaderSource> newSource (new juce::AudioFormatReaderSource
-                                                                      (reader, true));
-            jassert(reader->lengthInSamples%2048 == 0);
-            
-            for (int i = 0; i < reader->lengthInSamples / 2048; ++i)
-            {
-                tableBuffers.add(AudioBuffer<float>(reader->numChannels, 2048));
-                reader->read(&tableBuffers.getReference(tableBuffers.size()-1), 0,
-                             tableBuffers.getReference(tableBuffers.size()-1).getNumSamples(),
-                             i*2048, true, true);
-            }
-            
-            readerSource.reset(newSource.release());
-        }
-        else return File();
-        
-        Array<tWaveTableS> tables;
-        for (int i = 0; i < tableBuffers.size(); ++i)
-        {
-            tWaveTableS table;
-            tWaveTableS_init(&table, tableBuffers.getReference(i).getWritePointer(0), 2048, 14000.f, &leaf);
-            tables.add(table);
-        }
-        
-        if (waveTables.contains(setName))
-        {
-            waveTables.getReference(setName).addArray(tables);
-        }
-        else
-        {
-            waveTables.set(setName, tables);
-        }
-    }
-    
-    return file;
-}
-
 //==============================================================================
 void ESAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
@@ -1210,6 +1301,16 @@ void ESAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
     root.setProperty("editorScale", editorScale, nullptr);
     root.setProperty("mpeMode", mpeMode, nullptr);
     root.setProperty("numVoices", numVoicesActive, nullptr);
+    root.setProperty("controlRate", controlRateInterval, nullptr);
+    root.setProperty("renderThreads", getNumRenderThreads(), nullptr);
+    root.setProperty("oversampling", liveOversampling, nullptr);
+    root.setProperty("antiderivativeSaturator", liveAntiderivative, nullptr);
+    root.setProperty("offlineRandomSeed", (int)offlineRandomSeed, nullptr);
+    root.setProperty("sysexFormat", (int)sysexSender.getFormat(), nullptr);
+    root.setProperty("sysexRate", sysexSender.getBytesPerSecond(), nullptr);
+    root.setProperty("sysexQuantise", sysexSender.getQuantiseWaveTables(), nullptr);
+    root.setProperty("sysexLegacyWaveTables", sysexSender.getLegacyWaveTables(), nullptr);
+    root.setProperty("hardwareSync", hardwareSync.isEnabled(), nullptr);
     root.setProperty("pedalControlsMaster", pedalControlsMaster, nullptr);
     root.setProperty("midiKeyMin", midiKeyMin, nullptr);
     root.setProperty("midiKeyMax", midiKeyMax, nullptr);
@@ -1293,6 +1394,18 @@ void ESAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
         editorScale = xml->getDoubleAttribute("editorScale", 1.05);
         setMPEMode(xml->getBoolAttribute("mpeMode", true));
         setNumVoicesActive(xml->getIntAttribute("numVoices", 12));
+        setControlRateInterval(xml->getIntAttribute("controlRate", DEFAULT_CONTROL_RATE_INTERVAL));
+        setNumRenderThreads(xml->getIntAttribute("renderThreads", 1));
+        setOversampling(xml->getIntAttribute("oversampling", DEFAULT_MASTER_OVERSAMPLE));
+        setAntiderivativeSaturator(xml->getBoolAttribute("antiderivativeSaturator", false));
+        setOfflineRandomSeed((uint32_t)xml->getIntAttribute("offlineRandomSeed",
+                                                            (int)RANDOM_OFFLINE_SEED));
+        setSysexFormat((SysexFormat)jlimit(0, SysexFormatNil - 1,
+                                           xml->getIntAttribute("sysexFormat", LegacySysexFormat)));
+        setSysexBytesPerSecond(xml->getIntAttribute("sysexRate", SYSEX_DEFAULT_BYTES_PER_SECOND));
+        setSysexQuantiseWaveTables(xml->getBoolAttribute("sysexQuantise", true));
+        setSysexLegacyWaveTables(xml->getBoolAttribute("sysexLegacyWaveTables", false));
+        setHardwareSync(xml->getBoolAttribute("hardwareSync", false));
         pedalControlsMaster = xml->getBoolAttribute("pedalControlsVolume", true);
         midiKeyMin = xml->getIntAttribute("midiKeyMin", 21);
         midiKeyMax = xml->getIntAttribute("midiKeyMax", 108);
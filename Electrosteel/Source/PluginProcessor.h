@@ -17,6 +17,10 @@
 #include "Filters.h"
 #include "Envelopes.h"
 #include "Output.h"
+#include "RenderThreads.h"
+#include "Profiler.h"
+#include "SysexSender.h"
+#include "HardwareSync.h"
 
 class StandalonePluginHolder;
 
@@ -84,10 +88,61 @@ public:
     void setMPEMode(bool enabled);
     
     void setNumVoicesActive(int numVoices);
+    void setControlRateInterval(int interval);
+    // 1 renders every string on the audio thread; more shares groups of
+    // strings out to worker threads
+    void setNumRenderThreads(int numThreads);
+    int getNumRenderThreads() { return numRenderThreads; }
+    
+    // Memory kept for wavetables, shared with every other instance in the
+    // process. Tables no oscillator is using are freed least recently used
+    // first to stay within the budget
+    void setWaveTableMemoryBudget(size_t bytes) { waveTableLoader.setMemoryBudget(bytes); }
+    size_t getWaveTableMemoryUsage() { return waveTableLoader.getMemoryUsage(); }
+    
+    // Offline renders use the best quality settings and every render thread,
+    // then go back to the live settings
+    void setOfflineRender(bool offline);
+    
+    // Oversampling factor for the output saturator during live playback
+    void setOversampling(int factor);
+    int getOversampling() { return liveOversampling; }
+    // Whether the live saturator uses antiderivative antialiasing. Off by
+    // default, and for states saved before it existed, since it dulls the top
+    // octave a little (see StereoOversampler). Offline renders always use
+    // plain tanh at 8x
+    void setAntiderivativeSaturator(bool enabled) { liveAntiderivative = enabled; }
+    bool getAntiderivativeSaturator() { return liveAntiderivative; }
+    
+    // Restarts every random generator (noise and random on attack) from seed
+    void setRandomSeed(uint32_t seed);
+    // Seed offline renders restart from, whenever the processor is prepared
+    // offline or switches to offline; 0 carries on from wherever live
+    // playback left the generators
+    void setOfflineRandomSeed(uint32_t seed) { offlineRandomSeed = seed; }
+    uint32_t getOfflineRandomSeed() { return offlineRandomSeed; }
     
     //==============================================================================
+    void renderVoices(float samples[][RENDER_BLOCK_SIZE][NUM_STRINGS], int numSamples,
+                      int numChannels, float parallel, uint32_t voices, int partition);
+    void retireFinishedVoices(float samples[][RENDER_BLOCK_SIZE][NUM_STRINGS], int numSamples);
+    void retireVoice(int voice);
+    
+    //==============================================================================
+    // Queued and sent in the background, paced for the hardware
     void sendCopedentMidiMessage();
     void sendPresetMidiMessage();
+    void setSysexBytesPerSecond(int bytes) { sysexSender.setBytesPerSecond(bytes); }
+    // Legacy for firmware that doesn't read the packed format yet
+    void setSysexFormat(SysexFormat format) { sysexSender.setFormat(format); }
+    void setSysexQuantiseWaveTables(bool quantise) { sysexSender.setQuantiseWaveTables(quantise); }
+    // Legacy presets leave out wavetables unless this is on; see SysexSender
+    void setSysexLegacyWaveTables(bool send) { sysexSender.setLegacyWaveTables(send); }
+    // Mirrors edits to the hardware as they're made. Packed format only
+    void setHardwareSync(bool enabled) { hardwareSync.setEnabled(enabled); }
+    bool getHardwareSync() { return hardwareSync.isEnabled(); }
+    // Message thread
+    void captureHardwareState(HardwareState& state);
     
     //==============================================================================
     void addMappingSource(MappingSourceModel* source);
@@ -96,9 +151,6 @@ public:
     MappingSourceModel* getMappingSource(const String& name);
     MappingTargetModel* getMappingTarget(const String& name);
     
-    //==============================================================================
-    File loadWaveTables(const String& setName, File& file);
-    
     //==============================================================================
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
@@ -108,11 +160,10 @@ public:
     
     MidiKeyboardState keyboardState;
     
-    juce::AudioFormatManager formatManager;
-    std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
-    
     Array<File> waveTableFiles;
-    HashMap<String, Array<tWaveTableS>> waveTables;
+    WaveTableLoader waveTableLoader;
+    SysexSender sysexSender;
+    HardwareSync hardwareSync { *this, sysexSender };
 
     LEAF leaf;
     float voiceNote[NUM_STRINGS];
@@ -166,10 +217,33 @@ public:
     String copedentName = "";
     int copedentNumber = 0;
     
-    bool voiceIsSounding[NUM_STRINGS];
+    // Bit v is set from a note on for voice v until that voice is retired.
+    // Components only do work for the voices in getActiveVoices()
+    uint32_t voiceSoundingMask = 0;
+    void setVoiceSounding(int voice, bool sounding)
+    {
+        if (sounding) voiceSoundingMask |= 1u << voice;
+        else voiceSoundingMask &= ~(1u << voice);
+    }
+    bool isVoiceSounding(int voice) { return (voiceSoundingMask >> voice) & 1u; }
+    uint32_t getActiveVoices() { return voiceSoundingMask & ((1u << numVoicesActive) - 1u); }
+    
+    // Samples each released voice has been below VOICE_SILENCE_THRESHOLD
+    int voiceSilentSamples[NUM_STRINGS];
+    int voiceSilenceTimeout = 0;
     
     int numVoicesActive = 12;
     
+    // Stage timings, only filled in when built with ES_PROFILE
+    Profiler profiler;
+    
+    // Modulation hook sums are evaluated every controlRateInterval samples
+    // and ramped in between, except for audio rate targets and sources
+    int controlRateInterval = DEFAULT_CONTROL_RATE_INTERVAL;
+    // For the interval in use, which is 1 during offline renders
+    int controlRateMask = DEFAULT_CONTROL_RATE_INTERVAL - 1;
+    float invControlRateInterval = 1.f / DEFAULT_CONTROL_RATE_INTERVAL;
+    
     // Must be at least as large of the number of unique skews
     Array<float> invParameterSkews;
     float quickInvParameterSkews[MAX_NUM_UNIQUE_SKEWS];
@@ -204,14 +278,34 @@ private:
     int currentTuning;
     int keyCenter = 0;
     
-    bool waitingToSendCopedent = false;
-    bool waitingToSendPreset = false;
-    
     bool mpeMode = true;
     
     int stringActivity[NUM_STRINGS+1];
     int stringActivityTimeout;
     
+    // The voice section of one render chunk, split up by render thread
+    struct VoiceRender
+    {
+        ESAudioProcessor* processor;
+        float (*samples)[RENDER_BLOCK_SIZE][NUM_STRINGS];
+        int numSamples;
+        int numChannels;
+        float parallel;
+        uint32_t voices[MAX_RENDER_THREADS];
+    };
+    static void renderVoicesJob(void* context, int partition);
+    
+    RenderThreadPool renderThreads;
+    int numRenderThreads = 1;
+    bool offlineRender = false;
+    // Set once nothing is sounding and the output has died away
+    bool engineIdle = false;
+    int liveOversampling = DEFAULT_MASTER_OVERSAMPLE;
+    bool liveAntiderivative = false;
+    
+    VoiceRandom attackRandom;
+    uint32_t offlineRandomSeed = RANDOM_OFFLINE_SEED;
+    
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ESAudioProcessor)
 };
@@ -0,0 +1,142 @@
+/*
+  ==============================================================================
+
+    Profiler.cpp
+
+  ==============================================================================
+*/
+
+#include "Profiler.h"
+#include <algorithm>
+
+//==============================================================================
+Profiler::Profiler()
+{
+    prepareToPlay(sampleRate);
+}
+
+void Profiler::prepareToPlay(double sr)
+{
+    sampleRate = sr;
+    for (auto& slot : slots)
+    {
+        slot.last = 0;
+        for (auto& c : slot.cycles) c = 0;
+    }
+    historyPos = 0;
+    numHistory = 0;
+    blocksSincePublish = 0;
+    publishCycles = readCycleCounter();
+    publishTicks = Time::getHighResolutionTicks();
+}
+
+//==============================================================================
+void Profiler::beginBlock()
+{
+    for (auto& slot : slots)
+    {
+        for (auto& c : slot.cycles) c = 0;
+    }
+    blockStart = readCycleCounter();
+    slots[0].last = blockStart;
+}
+
+void Profiler::endBlock(int numSamples)
+{
+    uint64_t now = readCycleCounter();
+    
+    uint32_t* entry = history[historyPos];
+    for (int stage = 0; stage < ProfileBlock; ++stage)
+    {
+        uint64_t sum = 0;
+        for (auto& slot : slots) sum += slot.cycles[stage];
+        entry[stage] = (uint32_t)jmin(sum, (uint64_t)UINT32_MAX);
+    }
+    entry[ProfileBlock] = (uint32_t)jmin(now - blockStart, (uint64_t)UINT32_MAX);
+    historySamples[historyPos] = numSamples;
+    
+    historyPos = (historyPos + 1) % PROFILE_HISTORY;
+    numHistory = jmin(numHistory + 1, PROFILE_HISTORY);
+    
+    if (++blocksSincePublish >= PROFILE_PUBLISH_BLOCKS) publish(now);
+}
+
+void Profiler::publish(uint64_t now)
+{
+    blocksSincePublish = 0;
+    
+    // Rate of the cycle counter over the last interval, measured against the
+    // high resolution clock so frequency scaling and ARM timers just work
+    int64 ticks = Time::getHighResolutionTicks();
+    if (ticks > publishTicks && now > publishCycles)
+    {
+        cyclesPerSecond = (double)(now - publishCycles) *
+        (double)Time::getHighResolutionTicksPerSecond() / (double)(ticks - publishTicks);
+    }
+    publishCycles = now;
+    publishTicks = ticks;
+    
+    // Oldest first
+    Snapshot& snapshot = snapshots[back];
+    int oldest = (historyPos - numHistory + PROFILE_HISTORY) % PROFILE_HISTORY;
+    for (int i = 0; i < numHistory; ++i)
+    {
+        int b = (oldest + i) % PROFILE_HISTORY;
+        for (int stage = 0; stage < ProfileStageNil; ++stage)
+        {
+            snapshot.cycles[i][stage] = history[b][stage];
+        }
+        snapshot.numSamples[i] = historySamples[b];
+    }
+    snapshot.numBlocks = numHistory;
+    snapshot.sampleRate = sampleRate;
+    snapshot.cyclesPerSecond = cyclesPerSecond;
+    
+    back = middle.exchange(back | freshBit, std::memory_order_acq_rel) & indexMask;
+}
+
+//==============================================================================
+bool Profiler::getStats(StageStats stats[ProfileStageNil])
+{
+    if (middle.load(std::memory_order_relaxed) & freshBit)
+    {
+        front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+    }
+    
+    const Snapshot& snapshot = snapshots[front];
+    int n = snapshot.numBlocks;
+    if (n == 0 || snapshot.cyclesPerSecond <= 0.0) return false;
+    
+    double microsPerCycle = 1000000.0 / snapshot.cyclesPerSecond;
+    double budget = 0.0;
+    for (int i = 0; i < n; ++i) budget += snapshot.numSamples[i];
+    budget *= 1000000.0 / snapshot.sampleRate;
+    
+    float times[PROFILE_HISTORY];
+    for (int stage = 0; stage < ProfileStageNil; ++stage)
+    {
+        double sum = 0.0;
+        for (int i = 0; i < n; ++i)
+        {
+            times[i] = (float)(snapshot.cycles[i][stage] * microsPerCycle);
+            sum += times[i];
+        }
+        
+        StageStats& s = stats[stage];
+        s.avg = (float)(sum / n);
+        s.load = budget > 0.0 ? (float)(sum / budget) : 0.f;
+        
+        auto percentile = [&](float p)
+        {
+            float* nth = times + jmin(n - 1, (int)(p * n));
+            std::nth_element(times, nth, times + n);
+            return *nth;
+        };
+        s.p50 = percentile(0.5f);
+        s.p95 = percentile(0.95f);
+        s.p99 = percentile(0.99f);
+        s.min = *std::min_element(times, times + n);
+        s.max = *std::max_element(times, times + n);
+    }
+    return true;
+}
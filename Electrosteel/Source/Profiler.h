@@ -0,0 +1,171 @@
+/*
+  ==============================================================================
+
+    Profiler.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Constants.h"
+#include "SIMD.h"
+
+#if JUCE_MSVC
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Set to 1 (e.g. in the Projucer preprocessor definitions) to time each stage
+// of processBlock. With it off the profiling macros compile to nothing
+#ifndef ES_PROFILE
+#define ES_PROFILE 0
+#endif
+
+// Blocks of history the rolling statistics are taken over
+#define PROFILE_HISTORY 256
+// Blocks between snapshots being published for readers
+#define PROFILE_PUBLISH_BLOCKS 32
+
+typedef enum ProfileStage
+{
+    ProfileMidi = 0,
+    ProfileSysex,
+    ProfileFrame,
+    ProfileParameters,
+    ProfileEnvelopes,
+    ProfileLFOs,
+    ProfileOscillators,
+    ProfileNoise,
+    ProfileFilters,
+    ProfileOutput,
+    // The whole of processBlock, wall clock, including waiting on workers
+    ProfileBlock,
+    ProfileStageNil
+} ProfileStage;
+
+static const StringArray cProfileStageNames =
+{
+    "MIDI", "Sysex", "Frame", "Parameters", "Envelopes", "LFOs",
+    "Oscillators", "Noise", "Filters", "Output", "Block"
+};
+
+//==============================================================================
+// Ticks of the cheapest steady counter available: the TSC on x86, the
+// virtual timer on ARM. The rate is measured against the high resolution
+// clock rather than assumed
+static inline uint64_t readCycleCounter()
+{
+#if JUCE_MSVC && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t t;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(t));
+    return t;
+#else
+    return (uint64_t)Time::getHighResolutionTicks();
+#endif
+}
+
+//==============================================================================
+// Per block stage timings for processBlock. The audio thread and each render
+// worker only ever touch their own slot, so timing is a counter read and an
+// add. Every PROFILE_PUBLISH_BLOCKS blocks the history is copied into a
+// triple buffered snapshot, which a single reader (the editor or a debug
+// overlay) picks up without locking. Stages that run on the render threads
+// report the sum over all threads, i.e. CPU time rather than wall time.
+class Profiler
+{
+public:
+    //==============================================================================
+    struct StageStats
+    {
+        // Microseconds per block, over the last PROFILE_HISTORY blocks
+        float min, avg, max;
+        float p50, p95, p99;
+        // Share of the real time budget used on average, 1 being all of it
+        float load;
+    };
+    
+    Profiler();
+    
+    void prepareToPlay(double sampleRate);
+    
+    //==============================================================================
+    // Audio and render threads only
+    void beginBlock();
+    void endBlock(int numSamples);
+    
+    // Starts timing on the given slot; each render partition has its own
+    void start(int slot) { slots[slot].last = readCycleCounter(); }
+    // Charges the time since the last start or lap on this slot to stage
+    void lap(int slot, ProfileStage stage)
+    {
+        uint64_t now = readCycleCounter();
+        slots[slot].cycles[stage] += now - slots[slot].last;
+        slots[slot].last = now;
+    }
+    
+    //==============================================================================
+    // Reader thread only. Returns false until a snapshot has been published
+    bool getStats(StageStats stats[ProfileStageNil]);
+
+private:
+    //==============================================================================
+    struct Snapshot
+    {
+        int numBlocks = 0;
+        double sampleRate = 0.0;
+        double cyclesPerSecond = 0.0;
+        uint32_t cycles[PROFILE_HISTORY][ProfileStageNil];
+        int numSamples[PROFILE_HISTORY];
+    };
+    
+    void publish(uint64_t now);
+    
+    struct alignas(64) Slot
+    {
+        uint64_t last = 0;
+        uint64_t cycles[ProfileStageNil];
+    };
+    Slot slots[MAX_RENDER_THREADS];
+    uint64_t blockStart = 0;
+    
+    // Audio thread's copy of the history
+    uint32_t history[PROFILE_HISTORY][ProfileStageNil];
+    int historySamples[PROFILE_HISTORY];
+    int historyPos = 0;
+    int numHistory = 0;
+    int blocksSincePublish = 0;
+    
+    double sampleRate = 44100.0;
+    double cyclesPerSecond = 0.0;
+    uint64_t publishCycles = 0;
+    int64 publishTicks = 0;
+    
+    // Triple buffer: the writer owns back, the reader owns front, and middle
+    // holds the other index with freshBit set when it's newer than front
+    enum { indexMask = 3, freshBit = 4 };
+    Snapshot snapshots[3];
+    int back = 0;
+    int front = 1;
+    std::atomic<int> middle { 2 };
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Profiler)
+};
+
+#if ES_PROFILE
+#define ES_PROFILE_BEGIN_BLOCK(profiler) (profiler).beginBlock()
+#define ES_PROFILE_END_BLOCK(profiler, numSamples) (profiler).endBlock(numSamples)
+#define ES_PROFILE_START(profiler, slot) (profiler).start(slot)
+#define ES_PROFILE_LAP(profiler, slot, stage) (profiler).lap(slot, stage)
+#else
+#define ES_PROFILE_BEGIN_BLOCK(profiler)
+#define ES_PROFILE_END_BLOCK(profiler, numSamples)
+#define ES_PROFILE_START(profiler, slot)
+#define ES_PROFILE_LAP(profiler, slot, stage)
+#endif
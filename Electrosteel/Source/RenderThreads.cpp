@@ -0,0 +1,111 @@
+/*
+  ==============================================================================
+
+    RenderThreads.cpp
+
+  ==============================================================================
+*/
+
+#include "RenderThreads.h"
+#include "SIMD.h"
+#include <thread>
+
+// Tells the core we're in a spin loop so it can back off a bit
+static inline void spinPause()
+{
+#if ES_SIMD_SSE
+    _mm_pause();
+#elif defined(_M_ARM64)
+    __yield();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+//==============================================================================
+RenderThreadPool::~RenderThreadPool()
+{
+    setNumThreads(1);
+}
+
+void RenderThreadPool::setNumThreads(int numThreads)
+{
+    numThreads = jmax(1, numThreads);
+    
+    while (workers.size() > numThreads - 1)
+    {
+        Worker* worker = workers.getLast();
+        worker->signalThreadShouldExit();
+        worker->wake.signal();
+        worker->stopThread(1000);
+        workers.removeLast();
+    }
+    while (workers.size() < numThreads - 1)
+    {
+        Worker* worker = workers.add(new Worker(*this, workers.size() + 1));
+        worker->startThread(10);
+    }
+}
+
+void RenderThreadPool::run(Job newJob, void* newContext, int numPartitions)
+{
+    numPartitions = jlimit(1, getNumThreads(), numPartitions);
+    
+    job = newJob;
+    context = newContext;
+    pending.store(numPartitions - 1);
+    
+    for (int p = 1; p < numPartitions; ++p)
+    {
+        Worker* worker = workers.getUnchecked(p - 1);
+        worker->ready.store(true);
+        if (worker->sleeping.exchange(false)) worker->wake.signal();
+    }
+    
+    job(context, 0);
+    
+    while (pending.load() > 0) spinPause();
+}
+
+//==============================================================================
+RenderThreadPool::Worker::Worker(RenderThreadPool& pool, int partition) :
+Thread("Render " + String(partition)),
+pool(pool),
+partition(partition)
+{
+}
+
+RenderThreadPool::Worker::~Worker()
+{
+}
+
+void RenderThreadPool::Worker::run()
+{
+    int spins = 0;
+    
+    while (!threadShouldExit())
+    {
+        if (ready.load())
+        {
+            ready.store(false);
+            pool.job(pool.context, partition);
+            pool.pending.fetch_sub(1);
+            spins = 0;
+        }
+        else if (spins < RENDER_THREAD_SPINS)
+        {
+            spins++;
+            spinPause();
+        }
+        else
+        {
+            // Check ready again after saying we're asleep so a job posted in
+            // between is never missed; the timeout is only so exit is noticed
+            sleeping.store(true);
+            if (!ready.load()) wake.wait(100);
+            sleeping.store(false);
+        }
+    }
+}
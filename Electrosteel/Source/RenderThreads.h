@@ -0,0 +1,65 @@
+/*
+  ==============================================================================
+
+    RenderThreads.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Constants.h"
+
+//==============================================================================
+// A few worker threads, started ahead of time, that share a job split into
+// partitions with the audio thread. The audio thread runs partition 0 itself
+// and never takes a lock; it only signals a worker if that worker has gone to
+// sleep. Workers spin for a while after each job since the next block is
+// usually close behind, then sleep so an idle pool costs nothing.
+class RenderThreadPool
+{
+public:
+    //==============================================================================
+    typedef void (*Job)(void* context, int partition);
+    
+    RenderThreadPool() = default;
+    ~RenderThreadPool();
+    
+    //==============================================================================
+    // Starts or stops workers to leave numThreads - 1 of them. Must not be
+    // called while run() might be running
+    void setNumThreads(int numThreads);
+    int getNumThreads() { return workers.size() + 1; }
+    
+    // Calls job(context, p) for every p in [0, numPartitions), with partition
+    // 0 on the calling thread, and returns once all of them have finished.
+    // numPartitions must be no more than getNumThreads()
+    void run(Job job, void* context, int numPartitions);
+    
+private:
+    //==============================================================================
+    class Worker : public Thread
+    {
+    public:
+        Worker(RenderThreadPool& pool, int partition);
+        ~Worker() override;
+        
+        void run() override;
+        
+        RenderThreadPool& pool;
+        const int partition;
+        std::atomic<bool> ready { false };
+        std::atomic<bool> sleeping { false };
+        WaitableEvent wake;
+    };
+    
+    //==============================================================================
+    OwnedArray<Worker> workers;
+    
+    Job job = nullptr;
+    void* context = nullptr;
+    std::atomic<int> pending { 0 };
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RenderThreadPool)
+};
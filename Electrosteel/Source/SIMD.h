@@ -0,0 +1,250 @@
+/*
+  ==============================================================================
+
+    SIMD.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ES_SIMD_SSE 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define ES_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Lanes per vector. NUM_STRINGS should be a multiple of this so the per voice
+// banks split into whole vectors.
+#define SIMD_WIDTH 4
+
+//==============================================================================
+// Four floats processed together, one per string. Only wraps what the DSP
+// code actually needs; falls back to plain loops where there's no SSE/NEON.
+// Comparisons return lane masks (all bits set or clear) for use with the
+// bitwise ops, select() and movemask().
+struct float4
+{
+#if ES_SIMD_SSE
+    __m128 v;
+    float4() = default;
+    float4(__m128 v) : v(v) {}
+    static inline float4 load(const float* p) { return _mm_loadu_ps(p); }
+    static inline float4 broadcast(float x) { return _mm_set1_ps(x); }
+    inline void store(float* p) const { _mm_storeu_ps(p, v); }
+#elif ES_SIMD_NEON
+    float32x4_t v;
+    float4() = default;
+    float4(float32x4_t v) : v(v) {}
+    static inline float4 load(const float* p) { return vld1q_f32(p); }
+    static inline float4 broadcast(float x) { return vdupq_n_f32(x); }
+    inline void store(float* p) const { vst1q_f32(p, v); }
+#else
+    float v[SIMD_WIDTH];
+    float4() = default;
+    static inline float4 load(const float* p)
+    {
+        float4 r;
+        for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = p[i];
+        return r;
+    }
+    static inline float4 broadcast(float x)
+    {
+        float4 r;
+        for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = x;
+        return r;
+    }
+    inline void store(float* p) const
+    {
+        for (int i = 0; i < SIMD_WIDTH; ++i) p[i] = v[i];
+    }
+#endif
+};
+
+#if ES_SIMD_SSE
+inline float4 operator+(float4 a, float4 b) { return _mm_add_ps(a.v, b.v); }
+inline float4 operator-(float4 a, float4 b) { return _mm_sub_ps(a.v, b.v); }
+inline float4 operator*(float4 a, float4 b) { return _mm_mul_ps(a.v, b.v); }
+inline float4 operator/(float4 a, float4 b) { return _mm_div_ps(a.v, b.v); }
+inline float4 vmin(float4 a, float4 b) { return _mm_min_ps(a.v, b.v); }
+inline float4 vmax(float4 a, float4 b) { return _mm_max_ps(a.v, b.v); }
+inline float4 vabs(float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a.v); }
+inline float4 cmpge(float4 a, float4 b) { return _mm_cmpge_ps(a.v, b.v); }
+inline float4 cmplt(float4 a, float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+inline float4 operator&(float4 a, float4 b) { return _mm_and_ps(a.v, b.v); }
+inline float4 operator|(float4 a, float4 b) { return _mm_or_ps(a.v, b.v); }
+inline float4 operator^(float4 a, float4 b) { return _mm_xor_ps(a.v, b.v); }
+inline float4 select(float4 mask, float4 a, float4 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+inline int movemask(float4 mask) { return _mm_movemask_ps(mask.v); }
+inline float4 vfloor(float4 a)
+{
+    // SSE2 has no floor; truncate and step down where that rounded up
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.f)));
+}
+// 2^n for whole numbers n in [-126, 127], built straight into the exponent bits
+inline float4 vpow2i(float4 n)
+{
+    __m128i e = _mm_add_epi32(_mm_cvttps_epi32(n.v), _mm_set1_epi32(127));
+    return _mm_castsi128_ps(_mm_slli_epi32(e, 23));
+}
+// Splits positive normal x into a mantissa in [1, 2) and its exponent
+inline float4 vmantissa(float4 x, float4& exponent)
+{
+    __m128i bits = _mm_castps_si128(x.v);
+    exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    return _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)),
+                                         _mm_set1_epi32(0x3f800000)));
+}
+// One xorshift32 step on each lane of state (16 byte aligned, no lane zero),
+// returning floats in [0, 1) made from the top 23 bits
+inline float4 vrandom(uint32_t* state)
+{
+    __m128i x = _mm_load_si128((const __m128i*)state);
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+    _mm_store_si128((__m128i*)state, x);
+    __m128i bits = _mm_or_si128(_mm_srli_epi32(x, 9), _mm_set1_epi32(0x3f800000));
+    return _mm_sub_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1.f));
+}
+#elif ES_SIMD_NEON
+inline float4 operator+(float4 a, float4 b) { return vaddq_f32(a.v, b.v); }
+inline float4 operator-(float4 a, float4 b) { return vsubq_f32(a.v, b.v); }
+inline float4 operator*(float4 a, float4 b) { return vmulq_f32(a.v, b.v); }
+inline float4 operator/(float4 a, float4 b) { return vdivq_f32(a.v, b.v); }
+inline float4 vmin(float4 a, float4 b) { return vminq_f32(a.v, b.v); }
+inline float4 vmax(float4 a, float4 b) { return vmaxq_f32(a.v, b.v); }
+inline float4 vabs(float4 a) { return vabsq_f32(a.v); }
+inline float4 cmpge(float4 a, float4 b) { return vreinterpretq_f32_u32(vcgeq_f32(a.v, b.v)); }
+inline float4 cmplt(float4 a, float4 b) { return vreinterpretq_f32_u32(vcltq_f32(a.v, b.v)); }
+#define ES_SIMD_NEON_BITWISE(name, op) \
+inline float4 name(float4 a, float4 b) \
+{ \
+    return vreinterpretq_f32_u32(op(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))); \
+}
+ES_SIMD_NEON_BITWISE(operator&, vandq_u32)
+ES_SIMD_NEON_BITWISE(operator|, vorrq_u32)
+ES_SIMD_NEON_BITWISE(operator^, veorq_u32)
+#undef ES_SIMD_NEON_BITWISE
+inline float4 select(float4 mask, float4 a, float4 b)
+{
+    return vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v);
+}
+inline int movemask(float4 mask)
+{
+    static const int32_t shifts[4] = { 0, 1, 2, 3 };
+    uint32x4_t bits = vshrq_n_u32(vreinterpretq_u32_f32(mask.v), 31);
+    return (int) vaddvq_u32(vshlq_u32(bits, vld1q_s32(shifts)));
+}
+inline float4 vfloor(float4 a) { return vrndmq_f32(a.v); }
+inline float4 vpow2i(float4 n)
+{
+    int32x4_t e = vaddq_s32(vcvtq_s32_f32(n.v), vdupq_n_s32(127));
+    return vreinterpretq_f32_s32(vshlq_n_s32(e, 23));
+}
+inline float4 vmantissa(float4 x, float4& exponent)
+{
+    int32x4_t bits = vreinterpretq_s32_f32(x.v);
+    exponent = vcvtq_f32_s32(vsubq_s32(vshrq_n_s32(bits, 23), vdupq_n_s32(127)));
+    return vreinterpretq_f32_s32(vorrq_s32(vandq_s32(bits, vdupq_n_s32(0x007fffff)),
+                                           vdupq_n_s32(0x3f800000)));
+}
+inline float4 vrandom(uint32_t* state)
+{
+    uint32x4_t x = vld1q_u32(state);
+    x = veorq_u32(x, vshlq_n_u32(x, 13));
+    x = veorq_u32(x, vshrq_n_u32(x, 17));
+    x = veorq_u32(x, vshlq_n_u32(x, 5));
+    vst1q_u32(state, x);
+    uint32x4_t bits = vorrq_u32(vshrq_n_u32(x, 9), vdupq_n_u32(0x3f800000));
+    return vsubq_f32(vreinterpretq_f32_u32(bits), vdupq_n_f32(1.f));
+}
+#else
+inline uint32_t toBits(float x) { uint32_t b; std::memcpy(&b, &x, 4); return b; }
+inline float fromBits(uint32_t b) { float x; std::memcpy(&x, &b, 4); return x; }
+inline float maskFrom(bool b) { return fromBits(b ? 0xffffffffu : 0u); }
+#define ES_SIMD_SCALAR_OP(name, expr) \
+inline float4 name(float4 a, float4 b) \
+{ \
+    float4 r; \
+    for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = expr; \
+    return r; \
+}
+ES_SIMD_SCALAR_OP(operator+, a.v[i] + b.v[i])
+ES_SIMD_SCALAR_OP(operator-, a.v[i] - b.v[i])
+ES_SIMD_SCALAR_OP(operator*, a.v[i] * b.v[i])
+ES_SIMD_SCALAR_OP(operator/, a.v[i] / b.v[i])
+ES_SIMD_SCALAR_OP(vmin, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+ES_SIMD_SCALAR_OP(vmax, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+ES_SIMD_SCALAR_OP(cmpge, maskFrom(a.v[i] >= b.v[i]))
+ES_SIMD_SCALAR_OP(cmplt, maskFrom(a.v[i] < b.v[i]))
+ES_SIMD_SCALAR_OP(operator&, fromBits(toBits(a.v[i]) & toBits(b.v[i])))
+ES_SIMD_SCALAR_OP(operator|, fromBits(toBits(a.v[i]) | toBits(b.v[i])))
+ES_SIMD_SCALAR_OP(operator^, fromBits(toBits(a.v[i]) ^ toBits(b.v[i])))
+#undef ES_SIMD_SCALAR_OP
+inline float4 vabs(float4 a)
+{
+    float4 r;
+    for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = a.v[i] < 0.f ? -a.v[i] : a.v[i];
+    return r;
+}
+inline float4 select(float4 mask, float4 a, float4 b)
+{
+    float4 r;
+    for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = toBits(mask.v[i]) ? a.v[i] : b.v[i];
+    return r;
+}
+inline int movemask(float4 mask)
+{
+    int m = 0;
+    for (int i = 0; i < SIMD_WIDTH; ++i) m |= (toBits(mask.v[i]) >> 31) << i;
+    return m;
+}
+inline float4 vfloor(float4 a)
+{
+    float4 r;
+    for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = std::floor(a.v[i]);
+    return r;
+}
+inline float4 vpow2i(float4 n)
+{
+    float4 r;
+    for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = fromBits(uint32_t((int) n.v[i] + 127) << 23);
+    return r;
+}
+inline float4 vmantissa(float4 x, float4& exponent)
+{
+    float4 r;
+    for (int i = 0; i < SIMD_WIDTH; ++i)
+    {
+        uint32_t bits = toBits(x.v[i]);
+        exponent.v[i] = (float) ((int) (bits >> 23) - 127);
+        r.v[i] = fromBits((bits & 0x007fffffu) | 0x3f800000u);
+    }
+    return r;
+}
+inline float4 vrandom(uint32_t* state)
+{
+    float4 r;
+    for (int i = 0; i < SIMD_WIDTH; ++i)
+    {
+        uint32_t x = state[i];
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        state[i] = x;
+        r.v[i] = fromBits((x >> 9) | 0x3f800000u) - 1.f;
+    }
+    return r;
+}
+#endif
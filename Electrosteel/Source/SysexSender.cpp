@@ -0,0 +1,366 @@
+/*
+  ==============================================================================
+
+    SysexSender.cpp
+
+  ==============================================================================
+*/
+
+#include "SysexSender.h"
+
+//==============================================================================
+union uintfUnion
+{
+    float f;
+    uint32_t i;
+};
+
+// A float as five 7 bit groups, high bits first
+static void addFloat(uint8* dest, float value)
+{
+    union uintfUnion fu;
+    fu.f = value;
+    dest[0] = (fu.i >> 28) & 15;
+    dest[1] = (fu.i >> 21) & 127;
+    dest[2] = (fu.i >> 14) & 127;
+    dest[3] = (fu.i >> 7) & 127;
+    dest[4] = fu.i & 127;
+}
+
+// Every 7 bytes become 8, a byte of their top bits then the bytes without
+// them. Returns the encoded size
+static int encode8to7(const uint8* in, int size, uint8* out)
+{
+    int n = 0;
+    for (int i = 0; i < size; i += 7)
+    {
+        uint8& topBits = out[n++];
+        topBits = 0;
+        for (int j = 0; j < 7 && i + j < size; ++j)
+        {
+            topBits |= (uint8)((in[i+j] >> 7) << j);
+            out[n++] = in[i+j] & 127;
+        }
+    }
+    return n;
+}
+
+//==============================================================================
+SysexSender::SysexSender() :
+Thread("Sysex Sender")
+{
+    ring.allocate(SYSEX_FIFO_SIZE, true);
+    
+    startThread();
+}
+
+SysexSender::~SysexSender()
+{
+    stop();
+}
+
+void SysexSender::sendPreset(const Array<float>& values, const Array<WaveTableData::Ptr>& tables)
+{
+    SysexFormat f = format;
+    bool sendTables = f == PackedSysexFormat || legacyWaveTables;
+    queue({ Job::Preset, values, sendTables ? tables : Array<WaveTableData::Ptr>(), 0, f,
+        quantiseWaveTables, {} });
+}
+
+void SysexSender::sendCopedent(const Array<float>& values, int number)
+{
+    queue({ Job::Copedent, values, {}, number, format, quantiseWaveTables, {} });
+}
+
+void SysexSender::sendDelta(int syncId, const MemoryBlock& records, const Array<WaveTableData::Ptr>& tables)
+{
+    queue({ Job::Delta, {}, tables, syncId, PackedSysexFormat, quantiseWaveTables, records });
+}
+
+void SysexSender::stop()
+{
+    stopThread(4000);
+}
+
+void SysexSender::queue(Job&& job)
+{
+    {
+        const ScopedLock sl (lock);
+        
+        bool queued = false;
+        for (auto& waiting : jobs)
+        {
+            if (waiting.kind != job.kind) continue;
+            waiting = job;
+            queued = true;
+        }
+        if (!queued)
+        {
+            jobs.add(job);
+            numOutstanding++;
+        }
+    }
+    notify();
+}
+
+//==============================================================================
+void SysexSender::prepareToPlay(double sampleRate)
+{
+    currentSampleRate = sampleRate;
+    byteAllowance = 0.;
+}
+
+void SysexSender::renderNextBlock(MidiBuffer& midi, int numSamples)
+{
+    // Time spent with nothing to send isn't saved up for a burst later, but
+    // enough carries over for the largest packet to go eventually
+    double bytesThisBlock = bytesPerSecond * numSamples / currentSampleRate;
+    byteAllowance = jmin(byteAllowance + bytesThisBlock, bytesThisBlock + SYSEX_MAX_PACKET_SIZE);
+    
+    // The encoder writes each packet with its size in one go, so once the
+    // size is there the whole packet is
+    while (fifo.getNumReady() >= 2)
+    {
+        uint8 header[2];
+        readFifo(header, 2, false);
+        int size = header[0] | (header[1] << 8);
+        if (size > byteAllowance) return;
+        
+        readFifo(header, 2, true);
+        readFifo(packet, size, true);
+        midi.addEvent(packet, size, 0);
+        byteAllowance -= size;
+    }
+    byteAllowance = jmin(byteAllowance, bytesThisBlock);
+}
+
+void SysexSender::readFifo(uint8* dest, int numBytes, bool consume)
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(numBytes, start1, size1, start2, size2);
+    std::memcpy(dest, ring + start1, (size_t)size1);
+    if (size2 > 0) std::memcpy(dest + size1, ring + start2, (size_t)size2);
+    if (consume) fifo.finishedRead(size1 + size2);
+}
+
+//==============================================================================
+void SysexSender::run()
+{
+    while (!threadShouldExit())
+    {
+        Job job;
+        bool hasJob = false;
+        {
+            const ScopedLock sl (lock);
+            if (!jobs.isEmpty())
+            {
+                job = jobs.getFirst();
+                jobs.remove(0);
+                hasJob = true;
+            }
+        }
+        
+        if (!hasJob)
+        {
+            wait(-1);
+            continue;
+        }
+        
+        encode(job);
+        numOutstanding--;
+    }
+}
+
+void SysexSender::encode(const Job& job)
+{
+    if (job.format == PackedSysexFormat)
+    {
+        encodePacked(job);
+        return;
+    }
+    
+    if (job.kind == Job::Copedent)
+    {
+        // One message per column
+        uint8 payload[3 + 12 * 5];
+        for (int j = 0; j < job.values.size() / 12; ++j)
+        {
+            payload[0] = 1; // saying it's a copedent
+            payload[1] = (uint8)job.number; // which copedent number to store it as
+            payload[2] = (uint8)(50 + j);
+            for (int i = 0; i < 12; ++i) addFloat(payload + 3 + i * 5, job.values[i + j * 12]);
+            if (!writePacket(payload, sizeof(payload))) return;
+        }
+        return;
+    }
+    
+    // Parameter values then mappings, one value per message
+    uint8 payload[6];
+    payload[0] = 0; // saying it's a preset
+    for (auto value : job.values)
+    {
+        addFloat(payload + 1, value);
+        if (!writePacket(payload, sizeof(payload))) return;
+    }
+    
+    // Each set of tables, every level of every frame as its size then its samples
+    payload[0] = 2; // saying it's wavetable data
+    for (auto& data : job.tables)
+    {
+        for (int f = 0; f < data->getNumFrames(); ++f)
+        {
+            for (int l = 0; l < WAVETABLE_NUM_LEVELS; ++l)
+            {
+                int size = WaveTableData::getLevelSize(l);
+                const float* level = data->getLevel(f, l);
+                
+                addFloat(payload + 1, (float)size);
+                if (!writePacket(payload, sizeof(payload))) return;
+                for (int i = 0; i < size; ++i)
+                {
+                    addFloat(payload + 1, level[i]);
+                    if (!writePacket(payload, sizeof(payload))) return;
+                }
+            }
+        }
+    }
+}
+
+void SysexSender::encodePacked(const Job& job)
+{
+    if (job.kind == Job::Delta)
+    {
+        MemoryOutputStream stream;
+        stream.writeShort((short)job.number);
+        stream.write(job.records.getData(), job.records.getSize());
+        if (!writeTransfer(3, stream.getData(), stream.getDataSize())) return;
+        
+        for (auto& data : job.tables)
+        {
+            if (!writeWaveTables(*data, job.quantise)) return;
+        }
+        return;
+    }
+    
+    if (job.kind == Job::Copedent)
+    {
+        MemoryOutputStream stream;
+        stream.writeByte((char)job.number);
+        stream.writeByte((char)(job.values.size() / 12));
+        stream.writeByte(12);
+        for (int i = 0; i < job.values.size() / 12 * 12; ++i) stream.writeFloat(job.values[i]);
+        writeTransfer(1, stream.getData(), stream.getDataSize());
+        return;
+    }
+    
+    {
+        MemoryOutputStream stream;
+        stream.writeShort((short)job.values.size());
+        for (auto value : job.values) stream.writeFloat(value);
+        if (!writeTransfer(0, stream.getData(), stream.getDataSize())) return;
+    }
+    
+    for (auto& data : job.tables)
+    {
+        if (!writeWaveTables(*data, job.quantise)) return;
+    }
+}
+
+bool SysexSender::writeWaveTables(const WaveTableData& data, bool quantise)
+{
+    MemoryOutputStream stream;
+    stream.writeShort((short)data.getNumFrames());
+    stream.writeByte(WAVETABLE_NUM_LEVELS);
+    stream.writeByte(quantise ? 1 : 0);
+    for (int f = 0; f < data.getNumFrames(); ++f)
+    {
+        for (int l = 0; l < WAVETABLE_NUM_LEVELS; ++l)
+        {
+            int size = WaveTableData::getLevelSize(l);
+            const float* level = data.getLevel(f, l);
+            stream.writeShort((short)size);
+            
+            if (!quantise)
+            {
+                for (int i = 0; i < size; ++i) stream.writeFloat(level[i]);
+                continue;
+            }
+            
+            // Band-limiting can overshoot 1, so each level is scaled to fit
+            float scale = 0.f;
+            for (int i = 0; i < size; ++i) scale = jmax(scale, fabsf(level[i]));
+            if (scale == 0.f) scale = 1.f;
+            stream.writeFloat(scale);
+            for (int i = 0; i < size; ++i)
+            {
+                stream.writeShort((short)roundToInt(level[i] / scale * 32767.f));
+            }
+        }
+    }
+    return writeTransfer(2, stream.getData(), stream.getDataSize());
+}
+
+bool SysexSender::writeTransfer(uint8 type, const void* data, size_t size)
+{
+    uint8 payload[SYSEX_PACKED_MAX_PAYLOAD];
+    for (int i = 0; i < getNumTransferPackets(size); ++i)
+    {
+        int length = getTransferPacket(type, data, size, i, payload);
+        if (!writePacket(payload, length)) return false;
+    }
+    return true;
+}
+
+int SysexSender::getNumTransferPackets(size_t size)
+{
+    // An empty transfer is still one packet, to carry the last flag
+    return jmax(1, (int)((size + SYSEX_PACKED_CHUNK_SIZE - 1) / SYSEX_PACKED_CHUNK_SIZE));
+}
+
+int SysexSender::getTransferPacket(uint8 type, const void* data, size_t size, int index,
+                                   uint8 payload[SYSEX_PACKED_MAX_PAYLOAD])
+{
+    size_t offset = (size_t)index * SYSEX_PACKED_CHUNK_SIZE;
+    int chunk = (int)jmin((size_t)SYSEX_PACKED_CHUNK_SIZE, size - offset);
+    int sequence = index & 16383;
+    
+    payload[0] = SYSEX_PACKED_ID;
+    payload[1] = SYSEX_PACKED_VERSION;
+    payload[2] = type;
+    payload[3] = (uint8)((sequence >> 7) & 127);
+    payload[4] = (uint8)(sequence & 127);
+    payload[5] = index == getNumTransferPackets(size) - 1 ? 1 : 0;
+    int length = 6 + encode8to7((const uint8*)data + offset, chunk, payload + 6);
+    
+    int sum = 0;
+    for (int i = 1; i < length; ++i) sum += payload[i];
+    payload[length] = (uint8)((128 - (sum & 127)) & 127);
+    return length + 1;
+}
+
+bool SysexSender::writePacket(const uint8* payload, int size)
+{
+    jassert(size + 2 <= SYSEX_MAX_PACKET_SIZE);
+    
+    uint8 framed[SYSEX_MAX_PACKET_SIZE + 2];
+    int length = size + 2;
+    framed[0] = (uint8)(length & 0xff);
+    framed[1] = (uint8)(length >> 8);
+    framed[2] = 0xf0;
+    std::memcpy(framed + 3, payload, (size_t)size);
+    framed[length + 1] = 0xf7;
+    
+    // The audio thread frees space as the packets go out
+    while (fifo.getFreeSpace() < length + 2)
+    {
+        if (threadShouldExit()) return false;
+        wait(10);
+    }
+    
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(length + 2, start1, size1, start2, size2);
+    std::memcpy(ring + start1, framed, (size_t)size1);
+    if (size2 > 0) std::memcpy(ring + start2, framed + size1, (size_t)size2);
+    fifo.finishedWrite(size1 + size2);
+    return true;
+}
@@ -0,0 +1,174 @@
+/*
+  ==============================================================================
+
+    SysexSender.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "WaveTables.h"
+
+// Rate sysex is paced at, in bytes per second. An assumed default, not a
+// measured limit of the hardware: tune it against the firmware, and lower it
+// if packets are dropped. Saved states carry their own as sysexRate
+#define SYSEX_DEFAULT_BYTES_PER_SECOND 16384
+// Bytes of encoded packets waiting for the audio thread. The encoder waits
+// for room rather than encoding a whole wavetable set up front
+#define SYSEX_FIFO_SIZE 65536
+// Largest packet, F0 and F7 included
+#define SYSEX_MAX_PACKET_SIZE 1024
+// Packed packets start with the non-commercial manufacturer ID, which no
+// legacy message does, since those start with their type
+#define SYSEX_PACKED_ID 0x7d
+// Bump whenever the packed layout changes
+#define SYSEX_PACKED_VERSION 1
+// Bytes of a transfer carried per packet, before 8 to 7 bit encoding. A
+// multiple of 7 so only the last packet has a short group
+#define SYSEX_PACKED_CHUNK_SIZE 252
+// Largest packed payload, from the ID to the checksum
+#define SYSEX_PACKED_MAX_PAYLOAD (6 + (SYSEX_PACKED_CHUNK_SIZE + 6) / 7 * 8 + 1)
+
+typedef enum _SysexFormat
+{
+    // One float per message as a type byte and five 7 bit groups, which is
+    // all firmware before the packed format understands. Wavetables are only
+    // sent this way if asked for, see setLegacyWaveTables
+    LegacySysexFormat = 0,
+    // Each preset, copedent or wavetable set is one transfer, a byte stream
+    // split across numbered, checksummed packets. Every packet is
+    //   F0 7D version type seqHi seqLo flags <encoded chunk> checksum F7
+    // type is 0 preset, 1 copedent, 2 wavetable as in the legacy format, or
+    // 3 delta. seq
+    // counts packets from 0 within a transfer, 14 bits, wrapping. flags bit 0
+    // marks the last packet. The chunk is 8 to 7 bit encoded: each group of 7
+    // bytes becomes a byte of their top bits (first byte's in bit 0) followed
+    // by the 7 bytes without them. checksum makes the 7 bit sum of everything
+    // from version to checksum zero. The streams, little endian, are
+    //   preset:    u16 count, then count float32s (parameters then mappings)
+    //   copedent:  u8 number, u8 columns, u8 strings, then a float32 per
+    //              string of each column
+    //   wavetable: u16 frames, u8 levels, u8 sample format (0 float32,
+    //              1 int16), then for each level of each frame a u16 size, a
+    //              float32 scale if int16, and size samples. An int16 sample
+    //              is the sample / scale * 32767
+    //   delta:     u16 sync id, then records of a u8 kind and
+    //              0 parameter: u16 index, float32 value
+    //              1 mapping:   u16 target parameter, u8 target slot,
+    //                           s16 source (-1 for none), float32 range
+    //              2 copedent:  u8 number, u8 column, u8 string, float32
+    //              3 wavetable: u8 oscillator, u8 1 if a set follows
+    //              Each set that follows is its own wavetable transfer, in
+    //              the order of the records. The hardware acknowledges a
+    //              delta with F0 7D version 4 idHi idLo F7
+    PackedSysexFormat,
+    SysexFormatNil
+} SysexFormat;
+
+//==============================================================================
+// Sends presets and copedents to the Electrosteel. What's to be sent is copied
+// on the message thread, encoded into sysex packets on a background thread,
+// and queued in a lock-free FIFO. The audio thread only copies out as many
+// packets per block as the hardware's rate allows, so a big send is spread
+// over as many blocks as it needs and never holds up a block.
+class SysexSender : private Thread
+{
+public:
+    //==============================================================================
+    SysexSender();
+    ~SysexSender() override;
+    
+    //==============================================================================
+    // Message thread. Queued behind whatever is already sending, replacing a
+    // send of the same kind that hasn't started yet
+    void sendPreset(const Array<float>& values, const Array<WaveTableData::Ptr>& tables);
+    // Values are the copedent's columns one after another, 12 strings each
+    void sendCopedent(const Array<float>& values, int number);
+    // Packed format only. Records as laid out for a delta, and the sets its
+    // wavetable records say follow
+    void sendDelta(int syncId, const MemoryBlock& records, const Array<WaveTableData::Ptr>& tables);
+    
+    // True until the last packet queued has gone out
+    bool isSending() const { return numOutstanding > 0 || fifo.getNumReady() > 0; }
+    
+    void setBytesPerSecond(int bytes) { bytesPerSecond = jmax(1, bytes); }
+    int getBytesPerSecond() const { return bytesPerSecond; }
+    
+    // Used by sends from then on
+    void setFormat(SysexFormat f) { format = f; }
+    SysexFormat getFormat() const { return format; }
+    // Packed wavetables as 16 bit samples, half the size of floats
+    void setQuantiseWaveTables(bool quantise) { quantiseWaveTables = quantise; }
+    bool getQuantiseWaveTables() const { return quantiseWaveTables; }
+    // Whether legacy presets include their wavetables. Off by default since
+    // the levels sent are WaveTableData's, WAVETABLE_NUM_LEVELS of them from
+    // 4096 samples down to 256, not the 2048 sample tWaveTableS tables, with
+    // a count depending on the sample rate, that firmware reading the legacy
+    // format was written for. Only turn it on for firmware that takes the
+    // level sizes from the stream rather than assuming its own
+    void setLegacyWaveTables(bool send) { legacyWaveTables = send; }
+    bool getLegacyWaveTables() const { return legacyWaveTables; }
+    
+    void stop();
+    
+    //==============================================================================
+    // Packed format. The packets a transfer of size bytes is split into, and
+    // the payload of packet index, from the ID to the checksum, without F0
+    // and F7. Returns the payload's size
+    static int getNumTransferPackets(size_t size);
+    static int getTransferPacket(uint8 type, const void* data, size_t size, int index,
+                                 uint8 payload[SYSEX_PACKED_MAX_PAYLOAD]);
+    
+    //==============================================================================
+    void prepareToPlay(double sampleRate);
+    // Audio thread. Adds the packets due in the next numSamples to midi
+    void renderNextBlock(MidiBuffer& midi, int numSamples);
+    
+private:
+    //==============================================================================
+    struct Job
+    {
+        enum Kind { Preset, Copedent, Delta } kind;
+        Array<float> values;
+        Array<WaveTableData::Ptr> tables;
+        // The copedent number, or the delta's sync id
+        int number;
+        SysexFormat format;
+        bool quantise;
+        MemoryBlock records;
+    };
+    
+    void queue(Job&& job);
+    void run() override;
+    void encode(const Job& job);
+    void encodePacked(const Job& job);
+    // Splits a packed transfer into packets
+    bool writeTransfer(uint8 type, const void* data, size_t size);
+    bool writeWaveTables(const WaveTableData& data, bool quantise);
+    // Frames payload as sysex and waits for room for it in the FIFO. False
+    // if the thread was stopped first
+    bool writePacket(const uint8* payload, int size);
+    void readFifo(uint8* dest, int numBytes, bool consume);
+    
+    CriticalSection lock;
+    Array<Job> jobs;
+    std::atomic<int> numOutstanding { 0 };
+    
+    // Each packet is its size, two bytes little endian, then the packet
+    AbstractFifo fifo { SYSEX_FIFO_SIZE };
+    HeapBlock<uint8> ring;
+    
+    std::atomic<int> bytesPerSecond { SYSEX_DEFAULT_BYTES_PER_SECOND };
+    std::atomic<SysexFormat> format { LegacySysexFormat };
+    std::atomic<bool> quantiseWaveTables { true };
+    std::atomic<bool> legacyWaveTables { false };
+    
+    // Audio thread only
+    double currentSampleRate = 44100.;
+    double byteAllowance = 0.;
+    uint8 packet[SYSEX_MAX_PACKET_SIZE];
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SysexSender)
+};
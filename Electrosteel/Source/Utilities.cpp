@@ -11,6 +11,38 @@
 #include "Utilities.h"
 #include "PluginProcessor.h"
 
+//==============================================================================
+void fft(std::vector<std::complex<double>>& x, bool inverse)
+{
+    const size_t n = x.size();
+    for (size_t i = 1, j = 0; i < n; ++i)
+    {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(x[i], x[j]);
+    }
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        double angle = (inverse ? 2.0 : -2.0) * MathConstants<double>::pi / len;
+        std::complex<double> wlen(cos(angle), sin(angle));
+        for (size_t i = 0; i < n; i += len)
+        {
+            std::complex<double> w(1.0);
+            for (size_t j = 0; j < len / 2; ++j)
+            {
+                std::complex<double> a = x[i+j];
+                std::complex<double> b = x[i+j+len/2] * w;
+                x[i+j] = a + b;
+                x[i+j+len/2] = a - b;
+                w *= wlen;
+            }
+        }
+    }
+    if (inverse) for (auto& c : x) c /= (double) n;
+}
+
+//==============================================================================
 SmoothedParameter::SmoothedParameter(ESAudioProcessor& processor, AudioProcessorValueTreeState& vts,
                                      String paramId) :
 processor(processor)
@@ -20,28 +52,55 @@ processor(processor)
     range = parameter->getNormalisableRange();
     for (int i = 0; i < 3; ++i)
     {
-        hooks[i] = ParameterHook("", &value0, 0.0f, 0.0f, "", &value1);
+        hooks[i] = ParameterHook("", &value0, 0, 0.0f, 0.0f, "", &value1, 0);
         whichHooks[i] = 0;
     }
     processor.params.add(this);
     
+    control = raw->load();
+    
     for (int i = 0; i < processor.numInvParameterSkews; ++i)
     {
-        values[i] = value;
-        valuePointers[i] = &values[i];
+        for (int s = 0; s < RENDER_BLOCK_SIZE; ++s)
+        {
+            values[i][s] = value;
+        }
+        valuePointers[i] = values[i];
     }
 }
 
-float SmoothedParameter::tick()
+float SmoothedParameter::getTarget(int s)
 {
     // Well defined inter-thread behavior PROBABLY shouldn't be an issue here, so
     // the atomic is just slowing us down. memory_order_relaxed seems fastest, marginally
-    float target = raw->load(std::memory_order_relaxed);
-    for (int i = 0; i < numActiveHooks; ++i)
+    if (audioRate || audioRateHooks)
     {
-        target += hooks[whichHooks[i]].getValue();
+        float target = raw->load(std::memory_order_relaxed);
+        for (int i = 0; i < numActiveHooks; ++i)
+        {
+            target += hooks[whichHooks[i]].getValue(s);
+        }
+        controlIncrement = 0.f;
+        return control = target;
     }
-    smoothed.setTargetValue(target);
+    
+    // Otherwise only sum the hooks on control ticks and ramp to reach the
+    // new target by the next one
+    if ((s & processor.controlRateMask) == 0)
+    {
+        float target = raw->load(std::memory_order_relaxed);
+        for (int i = 0; i < numActiveHooks; ++i)
+        {
+            target += hooks[whichHooks[i]].getValue(s);
+        }
+        controlIncrement = (target - control) * processor.invControlRateInterval;
+    }
+    return control += controlIncrement;
+}
+
+float SmoothedParameter::tick(int s)
+{
+    smoothed.setTargetValue(getTarget(s));
     return value = smoothed.getNextValue();
 }
 
@@ -51,14 +110,9 @@ float SmoothedParameter::tickNoHooks()
     return value = smoothed.getNextValue();
 }
 
-float SmoothedParameter::tickNoSmoothing()
+float SmoothedParameter::tickNoSmoothing(int s)
 {
-    float target = raw->load(std::memory_order_relaxed);
-    for (int i = 0; i < numActiveHooks; ++i)
-    {
-        target += hooks[whichHooks[i]].getValue();
-    }
-    return value = target;
+    return value = getTarget(s);
 }
 
 float SmoothedParameter::tickNoHooksNoSmoothing()
@@ -66,55 +120,40 @@ float SmoothedParameter::tickNoHooksNoSmoothing()
     return value = raw->load(std::memory_order_relaxed);
 }
 
-void SmoothedParameter::tickSkews()
+void SmoothedParameter::tickSkews(int s)
 {
-    float target = raw->load(std::memory_order_relaxed);
-    for (int i = 0; i < numActiveHooks; ++i)
-    {
-        target += hooks[whichHooks[i]].getValue();
-    }
-    smoothed.setTargetValue(target);
+    smoothed.setTargetValue(getTarget(s));
     value = smoothed.getNextValue();
-    for (int i = 0; i < processor.numInvParameterSkews; ++i)
-    {
-        float invSkew = processor.quickInvParameterSkews[i];
-        values[i] = powf(value, invSkew);
-    }
+    computeSkews(s);
 }
 
-void SmoothedParameter::tickSkewsNoHooks()
+void SmoothedParameter::tickSkewsNoHooks(int s)
 {
     smoothed.setTargetValue(raw->load(std::memory_order_relaxed));
     value = smoothed.getNextValue();
-    for (int i = 0; i < processor.numInvParameterSkews; ++i)
-    {
-        float invSkew = processor.quickInvParameterSkews[i];
-        values[i] = powf(value, invSkew);
-    }
+    computeSkews(s);
 }
 
-void SmoothedParameter::tickSkewsNoSmoothing()
+void SmoothedParameter::tickSkewsNoSmoothing(int s)
 {
-    float target = raw->load(std::memory_order_relaxed);
-    for (int i = 0; i < numActiveHooks; ++i)
-    {
-        target += hooks[whichHooks[i]].getValue();
-    }
-    value = target;
-    for (int i = 0; i < processor.numInvParameterSkews; ++i)
-    {
-        float invSkew = processor.quickInvParameterSkews[i];
-        values[i] = powf(value, invSkew);
-    }
+    value = getTarget(s);
+    computeSkews(s);
 }
 
-void SmoothedParameter::tickSkewsNoHooksNoSmoothing()
+void SmoothedParameter::tickSkewsNoHooksNoSmoothing(int s)
 {
     value = raw->load(std::memory_order_relaxed);
-    for (int i = 0; i < processor.numInvParameterSkews; ++i)
+    computeSkews(s);
+}
+
+void SmoothedParameter::computeSkews(int s)
+{
+    values[0][s] = value;
+    for (int i = 1; i < processor.numInvParameterSkews; ++i)
     {
+        if (skewSource != nullptr && !skewSource->isSkewUsed(i)) continue;
         float invSkew = processor.quickInvParameterSkews[i];
-        values[i] = powf(value, invSkew);
+        values[i][s] = fastPow(value, invSkew);
     }
 }
 
@@ -123,7 +162,7 @@ float SmoothedParameter::skip(int numSamples)
     float target = raw->load(std::memory_order_relaxed);
     for (int i = 0; i < numActiveHooks; ++i)
     {
-        target += hooks[whichHooks[i]].getValue();
+        target += hooks[whichHooks[i]].getValue(0);
     }
     smoothed.setTargetValue(target);
     return value = smoothed.skip(numSamples);
@@ -134,9 +173,9 @@ float SmoothedParameter::get()
     return value;
 }
 
-float SmoothedParameter::get(int i)
+float SmoothedParameter::get(int i, int s)
 {
-    return values[i];
+    return values[i][s];
 }
 
 float** SmoothedParameter::getValuePointerArray()
@@ -154,15 +193,18 @@ ParameterHook& SmoothedParameter::getHook(int index)
     return hooks[index];
 }
 
-void SmoothedParameter::setHook(const String& sourceName, int index,
-             const float* hook, float min, float max)
+void SmoothedParameter::setHook(const String& sourceName, int index, const float* hook,
+                                int stride, bool audioRate, float min, float max)
 {
     hooks[index].sourceName = sourceName;
     hooks[index].hook = (float*)hook;
+    hooks[index].hookStride = stride;
+    hooks[index].audioRate = audioRate;
     hooks[index].min = min;
     hooks[index].length = max-min;
     
     if (numActiveHooks < 3) whichHooks[numActiveHooks++] = index;
+    updateAudioRateHooks();
 }
 
 void SmoothedParameter::setHookRange(int index, float min, float max)
@@ -171,10 +213,14 @@ void SmoothedParameter::setHookRange(int index, float min, float max)
     hooks[index].length = max-min;
 }
 
-void SmoothedParameter::setHookScalar(const String& scalarName, int index, float* scalar)
+void SmoothedParameter::setHookScalar(const String& scalarName, int index, float* scalar,
+                                      int stride, bool audioRate)
 {
     hooks[index].scalarName = scalarName;
     hooks[index].scalar = scalar;
+    hooks[index].scalarStride = stride;
+    hooks[index].scalarAudioRate = audioRate;
+    updateAudioRateHooks();
 }
 
 void SmoothedParameter::resetHook(int index)
@@ -183,10 +229,14 @@ void SmoothedParameter::resetHook(int index)
     
     hooks[index].sourceName = "";
     hooks[index].hook = &value0;
+    hooks[index].hookStride = 0;
     hooks[index].min = 0.0f;
     hooks[index].length = 0.0f;
     hooks[index].scalarName = "";
     hooks[index].scalar = &value1;
+    hooks[index].scalarStride = 0;
+    hooks[index].audioRate = false;
+    hooks[index].scalarAudioRate = false;
     
     numActiveHooks--;
     // If this hook was at the start or middle of the active
@@ -201,12 +251,27 @@ void SmoothedParameter::resetHook(int index)
     {
         whichHooks[1] = whichHooks[2];
     }
+    updateAudioRateHooks();
 }
 
 void SmoothedParameter::resetHookScalar(int index)
 {
     hooks[index].scalarName = "";
     hooks[index].scalar = &value1;
+    hooks[index].scalarStride = 0;
+    hooks[index].scalarAudioRate = false;
+    updateAudioRateHooks();
+}
+
+void SmoothedParameter::updateAudioRateHooks()
+{
+    bool audio = false;
+    for (int i = 0; i < numActiveHooks; ++i)
+    {
+        ParameterHook& h = hooks[whichHooks[i]];
+        audio = audio || h.audioRate || h.scalarAudioRate;
+    }
+    audioRateHooks = audio;
 }
 
 float SmoothedParameter::getStart()
@@ -228,13 +293,16 @@ void SmoothedParameter::prepareToPlay(double sampleRate, int samplesPerBlock)
 //==============================================================================
 
 MappingSourceModel::MappingSourceModel(ESAudioProcessor& p, const String &name,
-                                       bool perVoice, bool bipolar, Colour colour) :
+                                       bool perVoice, bool perSample, bool bipolar,
+                                       Colour colour) :
 name(name),
 numSourcePointers(perVoice ? NUM_STRINGS : 1),
+sampleStride(perSample ? (perVoice ? NUM_STRINGS : 1) : 0),
 bipolar(bipolar),
 colour(colour),
 modelProcessor(p)
 {
+    for (int i = 0; i < MAX_NUM_UNIQUE_SKEWS; ++i) skewUsers[i] = 0;
     p.addMappingSource(this);
 }
 
@@ -253,6 +321,53 @@ int MappingSourceModel::getNumSourcePointers()
     return numSourcePointers;
 }
 
+int MappingSourceModel::getSampleStride()
+{
+    return sampleStride;
+}
+
+void MappingSourceModel::addSkewUser(int skew)
+{
+    if (skew >= 0) skewUsers[skew]++;
+}
+
+void MappingSourceModel::removeSkewUser(int skew)
+{
+    if (skew >= 0 && skewUsers[skew] > 0) skewUsers[skew]--;
+}
+
+int MappingSourceModel::getUsedSkews(int* skews)
+{
+    int n = 0;
+    for (int i = 1; i < modelProcessor.numInvParameterSkews; ++i)
+    {
+        if (skewUsers[i] > 0) skews[n++] = i;
+    }
+    return n;
+}
+
+void MappingSourceModel::fillSkews(int numSamples, uint32_t voices)
+{
+    int usedSkews[MAX_NUM_UNIQUE_SKEWS];
+    int numUsedSkews = getUsedSkews(usedSkews);
+    const float* values = *sources[0];
+    for (int i = 0; i < numUsedSkews; ++i)
+    {
+        int skew = usedSkews[i];
+        float* skewed = *sources[skew];
+        float4 invSkew = float4::broadcast(modelProcessor.quickInvParameterSkews[skew]);
+        for (int v = 0; v < NUM_STRINGS; v += SIMD_WIDTH)
+        {
+            if (!voiceGroupIsActive(voices, v)) continue;
+            for (int s = 0; s < numSamples; ++s)
+            {
+                int j = s*NUM_STRINGS + v;
+                fastPow(float4::load(values + j), invSkew).store(skewed + j);
+            }
+        }
+    }
+}
+
 //==============================================================================
 //==============================================================================
 
@@ -265,6 +380,7 @@ targetParameters(targetParameters),
 index(index)
 {
     invSkew = targetParameters[0]->getInvSkew();
+    skewIndex = p.invParameterSkews.indexOf(invSkew);
 }
 
 MappingTargetModel::~MappingTargetModel()
@@ -280,8 +396,13 @@ void MappingTargetModel::setMapping(MappingSourceModel* source, float e, bool se
 {
     if (source == nullptr) return;
     
-    if (currentSource != nullptr) processor.sourceMappingCounts.getReference(currentSource->name)--;
+    if (currentSource != nullptr)
+    {
+        processor.sourceMappingCounts.getReference(currentSource->name)--;
+        currentSource->removeSkewUser(skewIndex);
+    }
     processor.sourceMappingCounts.getReference(source->name)++;
+    source->addSkewUser(skewIndex);
     
     currentSource = source;
     bipolar = source->isBipolar();
@@ -302,11 +423,11 @@ void MappingTargetModel::setMapping(MappingSourceModel* source, float e, bool se
         DBG("End: " + String(end));
     }
     
-    float* sourceArray =
-    *source->getValuePointerArray(processor.invParameterSkews.indexOf(invSkew));
+    float* sourceArray = *source->getValuePointerArray(skewIndex);
     for (auto param : targetParameters)
     {
-        param->setHook(source->name, index, &sourceArray[i%n], start, end);
+        param->setHook(source->name, index, &sourceArray[i%n], source->getSampleStride(),
+                       source->isAudioRate(), start, end);
         i++;
     }
     
@@ -356,7 +477,8 @@ void MappingTargetModel::setMappingScalar(MappingSourceModel* source, bool sendC
     float* sourceArray = *source->getValuePointerArray(0);
     for (auto param : targetParameters)
     {
-        param->setHookScalar(source->name, index, &sourceArray[i%n]);
+        param->setHookScalar(source->name, index, &sourceArray[i%n],
+                             source->getSampleStride(), source->isAudioRate());
         i++;
     }
     
@@ -366,6 +488,7 @@ void MappingTargetModel::setMappingScalar(MappingSourceModel* source, bool sendC
 void MappingTargetModel::removeMapping(bool sendChangeEvent)
 {
     processor.sourceMappingCounts.getReference(currentSource->name)--;
+    currentSource->removeSkewUser(skewIndex);
     
     currentSource = nullptr;
     currentScalarSource = nullptr;
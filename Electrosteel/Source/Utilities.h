@@ -12,8 +12,40 @@
 
 #include <JuceHeader.h>
 #include "Constants.h"
+#include "FastMath.h"
+#include <complex>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 class ESAudioProcessor;
+class MappingSourceModel;
+
+//==============================================================================
+// Voice masks have bit v set for voice v. Walk the set voices with
+//     for (uint32_t m = mask; m; m &= m - 1) { int v = lowestVoice(m); ... }
+inline int lowestVoice(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long v;
+    _BitScanForward(&v, mask);
+    return (int) v;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// Whether any voice in the group of SIMD_WIDTH voices starting at v is set
+inline bool voiceGroupIsActive(uint32_t mask, int v)
+{
+    return ((mask >> v) & ((1u << SIMD_WIDTH) - 1)) != 0;
+}
+
+// In place radix-2 FFT; x.size() must be a power of two. The inverse is
+// scaled by 1/n
+void fft(std::vector<std::complex<double>>& x, bool inverse);
 
 //==============================================================================
 class ParameterHook
@@ -22,33 +54,46 @@ public:
     //==============================================================================
     ParameterHook() = default;
     
-    ParameterHook(String sourceName, float* hook, float min, float max,
-                  String scalarName, float* scalar) :
+    ParameterHook(String sourceName, float* hook, int hookStride, float min, float max,
+                  String scalarName, float* scalar, int scalarStride) :
     sourceName(sourceName),
     hook(hook),
+    hookStride(hookStride),
     min(min),
     length(max-min),
     scalarName(scalarName),
-    scalar(scalar)
+    scalar(scalar),
+    scalarStride(scalarStride),
+    audioRate(false),
+    scalarAudioRate(false)
     {
     }
     
     ~ParameterHook() {};
     
     //==============================================================================
-    inline float getValue()
+    // s is the sample index within the current render block. Sources that are
+    // rendered per sample keep a block of values and the stride steps through it;
+    // sources that only change per block or per note have a stride of 0
+    inline float getValue(int s)
     {
         // Significant bottleneck; gets called for each hook for each param
         // for each voice every tick so if there's any possible
         // optimization here it should be impactful
-        return ((*hook * length) + min) * *scalar;
+        return ((hook[s*hookStride] * length) + min) * scalar[s*scalarStride];
     }
 
     String sourceName;
     float* hook;
+    int hookStride;
     float min, length;
     String scalarName;
     float* scalar;
+    int scalarStride;
+    // Set when the hook or scalar source changes at audio rate (oscillators,
+    // noise) and can't be sampled at control rate without changing the sound
+    bool audioRate;
+    bool scalarAudioRate;
 };
 
 //==============================================================================
@@ -62,27 +107,38 @@ public:
                       String paramId);
     ~SmoothedParameter() {};
     //==============================================================================
-    float tick();
+    // s is the sample index within the current render block
+    float tick(int s);
     float tickNoHooks();
-    float tickNoSmoothing();
+    float tickNoSmoothing(int s);
     float tickNoHooksNoSmoothing();
-    void tickSkews();
-    void tickSkewsNoHooks();
-    void tickSkewsNoSmoothing();
-    void tickSkewsNoHooksNoSmoothing();
+    void tickSkews(int s);
+    void tickSkewsNoHooks(int s);
+    void tickSkewsNoSmoothing(int s);
+    void tickSkewsNoHooksNoSmoothing(int s);
     
     float skip(int numSamples);
+    
+    // Skewed values are only computed for the skews that targets of source
+    // are actually mapped with; without a source every skew is computed
+    void setSkewSource(MappingSourceModel* source) { skewSource = source; }
+    
+    // Audio rate parameters sum their hooks every sample instead of every
+    // control rate interval; for targets where the ramp between control
+    // ticks would be audible, like oscillator pitch
+    void setAudioRate(bool audio) { audioRate = audio; }
 
     float get();
-    float get(int i);
+    float get(int i, int s);
     float** getValuePointerArray();
     float** getValuePointerArray(int i);
     
     ParameterHook& getHook(int index);
-    void setHook(const String& sourceName, int index,
-                 const float* hook, float min, float max);
+    void setHook(const String& sourceName, int index, const float* hook,
+                 int stride, bool audioRate, float min, float max);
     void setHookRange(int index, float min, float max);
-    void setHookScalar(const String& scalarName, int index, float* scalar);
+    void setHookScalar(const String& scalarName, int index, float* scalar,
+                       int stride, bool audioRate);
     void resetHook(int index);
     void resetHookScalar(int index);
     
@@ -96,6 +152,10 @@ public:
     float getRawValue() { return *raw; }
     
 private:
+    float getTarget(int s);
+    void computeSkews(int s);
+    void updateAudioRateHooks();
+    
     ESAudioProcessor& processor;
     
     SmoothedValue<float, ValueSmoothingTypes::Linear> smoothed;
@@ -104,12 +164,21 @@ private:
     NormalisableRange<float> range;
     float value = 0.f;
     float* valuePointer = &value;
-    float values[MAX_NUM_UNIQUE_SKEWS];
+    // Skewed values for each sample of the current render block
+    float values[MAX_NUM_UNIQUE_SKEWS][RENDER_BLOCK_SIZE];
     float* valuePointers[MAX_NUM_UNIQUE_SKEWS];
     ParameterHook hooks[3];
     int numActiveHooks = 0;
     int whichHooks[3];
     
+    MappingSourceModel* skewSource = nullptr;
+    
+    bool audioRate = false;
+    bool audioRateHooks = false;
+    // Raw value plus hooks, ramped linearly between control ticks
+    float control = 0.f;
+    float controlIncrement = 0.f;
+    
     float value0 = 0.0f;
     float value1 = 1.0f;
 };
@@ -120,19 +189,40 @@ private:
 class MappingSourceModel
 {
 public:
+    // perSample sources fill a value for every sample of the render block,
+    // laid out [sample][voice], rather than holding one value per voice
     MappingSourceModel(ESAudioProcessor& p, const String &name,
-                       bool perVoice, bool bipolar, Colour colour);
+                       bool perVoice, bool perSample, bool bipolar, Colour colour);
     ~MappingSourceModel();
     
     bool isBipolar() { return bipolar; }
+    bool isAudioRate() { return audioRate; }
 
     float** getValuePointerArray(int i);
     int getNumSourcePointers();
+    int getSampleStride();
+    
+    // Targets register the skew they read this source through so sources
+    // only fill the skewed arrays somebody is using. Skew 0 is the unskewed
+    // value, always filled, and also what scalars read
+    void addSkewUser(int skew);
+    void removeSkewUser(int skew);
+    bool isSkewUsed(int skew) { return skew == 0 || skewUsers[skew] > 0; }
+    // Fills skews with the indices of the used skews other than 0
+    int getUsedSkews(int* skews);
+    // For per voice, per sample sources: fills the used skewed copies of the
+    // first numSamples of the block from the unskewed values, only for the
+    // groups of SIMD_WIDTH voices that have a voice in voices
+    void fillSkews(int numSamples, uint32_t voices);
     
     String name;
     float** sources[MAX_NUM_UNIQUE_SKEWS];
     int numSourcePointers;
+    int sampleStride;
     bool bipolar;
+    // Audio signal sources; anything they're mapped to is evaluated every sample
+    bool audioRate = false;
+    int skewUsers[MAX_NUM_UNIQUE_SKEWS];
     Colour colour;
     
 private:
@@ -175,6 +265,7 @@ public:
     float start, end;
     bool bipolar;
     float invSkew;
+    int skewIndex;
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MappingTargetModel)
 };
@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    VoiceRandom.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Constants.h"
+#include "SIMD.h"
+#include "Utilities.h"
+
+//==============================================================================
+// A seeded xorshift32 generator per string, laid out so each group of
+// SIMD_WIDTH strings steps together in one vector. A string's values only
+// depend on the seed and on what's been drawn for its group, never on other
+// groups or on which thread renders it, so renders with the same seed and
+// the same notes come out the same.
+class VoiceRandom
+{
+public:
+    //==============================================================================
+    VoiceRandom() { seed(RANDOM_DEFAULT_SEED); }
+    
+    void seed(uint32_t seed)
+    {
+        for (int v = 0; v < NUM_STRINGS; ++v)
+        {
+            // Mixed so nearby seeds and strings start far apart
+            uint32_t z = seed + 0x9e3779b9u * (uint32_t)(v + 1);
+            z = (z ^ (z >> 16)) * 0x85ebca6bu;
+            z = (z ^ (z >> 13)) * 0xc2b2ae35u;
+            z ^= z >> 16;
+            // xorshift never leaves zero
+            state[v] = z != 0 ? z : 0x6d2b79f5u;
+        }
+    }
+    
+    // Next value in [0, 1) for one string
+    float next(int voice)
+    {
+        uint32_t x = state[voice];
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        state[voice] = x;
+        uint32_t bits = (x >> 9) | 0x3f800000u;
+        float f;
+        std::memcpy(&f, &bits, 4);
+        return f - 1.f;
+    }
+    
+    // Values in [0, 1) for every group of strings with a voice in voiceMask,
+    // laid out [sample][voice]
+    void fill(float output[][NUM_STRINGS], int numSamples, uint32_t voiceMask)
+    {
+        for (int v = 0; v < NUM_STRINGS; v += SIMD_WIDTH)
+        {
+            if (!voiceGroupIsActive(voiceMask, v)) continue;
+            
+            for (int s = 0; s < numSamples; ++s)
+            {
+                vrandom(&state[v]).store(&output[s][v]);
+            }
+        }
+    }
+
+private:
+    alignas(16) uint32_t state[NUM_STRINGS];
+};
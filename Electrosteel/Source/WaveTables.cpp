@@ -0,0 +1,350 @@
+/*
+  ==============================================================================
+
+    WaveTables.cpp
+
+  ==============================================================================
+*/
+
+#include "WaveTables.h"
+#include "Oscillators.h"
+#include "Utilities.h"
+
+//==============================================================================
+WaveTableData::WaveTableData(const Array<AudioBuffer<float>>& frames) :
+numFrames(frames.size())
+{
+    allocated.allocate((size_t)numFrames * getFrameSize(), true);
+    samples = allocated.get();
+    
+    const int n = WAVETABLE_FRAME_SIZE;
+    std::vector<std::complex<double>> spectrum (n);
+    std::vector<std::complex<double>> level;
+    
+    for (int f = 0; f < numFrames; ++f)
+    {
+        const float* frame = frames.getReference(f).getReadPointer(0);
+        for (int i = 0; i < n; ++i) spectrum[i] = frame[i];
+        fft(spectrum, false);
+        
+        for (int l = 0; l < WAVETABLE_NUM_LEVELS; ++l)
+        {
+            // Below the frame's own Nyquist, which has no phase to keep
+            int harmonics = jmin((n / 2) >> l, n / 2 - 1);
+            int size = getLevelSize(l);
+            double scale = (double)size / n;
+            
+            level.assign(size, 0.0);
+            level[0] = spectrum[0] * scale;
+            for (int k = 1; k <= harmonics; ++k)
+            {
+                level[k] = spectrum[k] * scale;
+                level[size-k] = spectrum[n-k] * scale;
+            }
+            fft(level, true);
+            
+            float* out = allocated.get() + (size_t)f * getFrameSize() + getLevelOffset(l);
+            for (int i = 0; i < size; ++i) out[i] = (float)level[i].real();
+            out[size] = out[0];
+        }
+    }
+}
+
+WaveTableData::WaveTableData(const File& cacheFile)
+{
+    MemoryMappedFile mapped (cacheFile, MemoryMappedFile::readOnly);
+    const char* data = (const char*)mapped.getData();
+    if (data == nullptr || mapped.getSize() < sizeof(CacheHeader)) return;
+    
+    CacheHeader header;
+    std::memcpy(&header, data, sizeof(CacheHeader));
+    size_t size = sizeof(CacheHeader) + (size_t)header.numFrames * getFrameSize() * sizeof(float);
+    if (std::memcmp(header.magic, "ESWT", 4) != 0 ||
+        header.version != WAVETABLE_CACHE_VERSION ||
+        header.frameSize != WAVETABLE_FRAME_SIZE ||
+        header.numLevels != WAVETABLE_NUM_LEVELS ||
+        header.numFrames == 0 ||
+        mapped.getSize() != size) return;
+    
+    // Copied out rather than read through the mapping, whose pages the OS
+    // can drop under memory pressure and the audio thread would fault back in
+    numFrames = (int)header.numFrames;
+    allocated.allocate((size_t)numFrames * getFrameSize(), false);
+    std::memcpy(allocated.get(), data + sizeof(CacheHeader), size - sizeof(CacheHeader));
+    samples = allocated.get();
+}
+
+bool WaveTableData::save(const File& cacheFile) const
+{
+    if (!cacheFile.getParentDirectory().createDirectory().wasOk()) return false;
+    
+    // Written alongside and moved into place so a reader never sees half a file
+    TemporaryFile temp (cacheFile);
+    {
+        FileOutputStream out (temp.getFile());
+        if (!out.openedOk()) return false;
+        
+        CacheHeader header = { { 'E', 'S', 'W', 'T' }, WAVETABLE_CACHE_VERSION,
+            WAVETABLE_FRAME_SIZE, WAVETABLE_NUM_LEVELS, (uint32_t)numFrames, { 0, 0, 0 } };
+        if (!out.write(&header, sizeof(CacheHeader)) ||
+            !out.write(samples, (size_t)numFrames * getFrameSize() * sizeof(float))) return false;
+    }
+    return temp.overwriteTargetFileWithTemporary();
+}
+
+//==============================================================================
+WaveTableData::Ptr WaveTableStore::find(int64 hash)
+{
+    const ScopedLock sl (lock);
+    if (!tables.contains(hash)) return nullptr;
+    
+    Entry& entry = tables.getReference(hash);
+    entry.lastUsed = ++useCount;
+    return entry.data;
+}
+
+WaveTableData::Ptr WaveTableStore::add(int64 hash, WaveTableData::Ptr data)
+{
+    const ScopedLock sl (lock);
+    if (tables.contains(hash))
+    {
+        Entry& entry = tables.getReference(hash);
+        entry.lastUsed = ++useCount;
+        return entry.data;
+    }
+    
+    tables.set(hash, { data, ++useCount });
+    memoryUsage += data->getSizeInBytes();
+    return data;
+}
+
+void WaveTableStore::trim()
+{
+    const ScopedLock sl (lock);
+    
+    // Anything a set still refers to counts as used now
+    Array<int64> hashes;
+    for (HashMap<int64, Entry>::Iterator i (tables); i.next();) hashes.add(i.getKey());
+    for (auto hash : hashes)
+    {
+        Entry& entry = tables.getReference(hash);
+        if (entry.data->getReferenceCount() > 1) entry.lastUsed = useCount;
+    }
+    
+    while (memoryUsage > memoryBudget)
+    {
+        int64 oldest = 0;
+        int64 oldestUse = std::numeric_limits<int64>::max();
+        for (auto hash : hashes)
+        {
+            if (!tables.contains(hash)) continue;
+            const Entry& entry = tables.getReference(hash);
+            if (entry.data->getReferenceCount() == 1 && entry.lastUsed < oldestUse)
+            {
+                oldest = hash;
+                oldestUse = entry.lastUsed;
+            }
+        }
+        if (oldestUse == std::numeric_limits<int64>::max()) break;
+        
+        memoryUsage -= tables.getReference(oldest).data->getSizeInBytes();
+        tables.remove(oldest);
+    }
+}
+
+size_t WaveTableStore::getMemoryUsage()
+{
+    const ScopedLock sl (lock);
+    return memoryUsage;
+}
+
+//==============================================================================
+WaveTableLoader::WaveTableLoader() :
+Thread("Wavetable Loader")
+{
+    formatManager.registerBasicFormats();
+    
+    startThread();
+}
+
+WaveTableLoader::~WaveTableLoader()
+{
+    stop();
+}
+
+void WaveTableLoader::load(Oscillator& oscillator, const File& file)
+{
+    {
+        const ScopedLock sl (lock);
+        
+        bool queued = false;
+        for (auto& request : requests)
+        {
+            if (request.oscillator != &oscillator) continue;
+            request.file = file;
+            queued = true;
+        }
+        if (!queued)
+        {
+            requests.add({ &oscillator, file });
+            numOutstanding++;
+        }
+    }
+    notify();
+}
+
+bool WaveTableLoader::waitUntilLoaded(int timeoutMs)
+{
+    uint32 end = Time::getMillisecondCounter() + (uint32)timeoutMs;
+    while (numOutstanding > 0)
+    {
+        if (Time::getMillisecondCounter() >= end) return false;
+        Thread::sleep(1);
+    }
+    return true;
+}
+
+WaveTableData::Ptr WaveTableLoader::getLoadedData(Oscillator& oscillator)
+{
+    const ScopedLock sl (lock);
+    for (auto& l : loaded)
+    {
+        if (l.oscillator == &oscillator) return l.data;
+    }
+    return nullptr;
+}
+
+void WaveTableLoader::stop()
+{
+    stopThread(4000);
+}
+
+void WaveTableLoader::setMemoryBudget(size_t bytes)
+{
+    store->setMemoryBudget(bytes);
+    // Trimmed on the loader thread
+    notify();
+}
+
+File WaveTableLoader::getCacheDirectory()
+{
+    return File::getSpecialLocation(File::userApplicationDataDirectory)
+    .getChildFile("Electrosteel").getChildFile("WaveTableCache");
+}
+
+//==============================================================================
+void WaveTableLoader::run()
+{
+    while (!threadShouldExit())
+    {
+        Array<Request> work;
+        {
+            const ScopedLock sl (lock);
+            work.swapWith(requests);
+        }
+        
+        for (auto& request : work)
+        {
+            if (threadShouldExit()) return;
+            
+            if (WaveTableData::Ptr data = loadData(request.file))
+            {
+                request.oscillator->publishWaveTables(new WaveTableSet { request.file, data });
+                oscillators.addIfNotAlreadyThere(request.oscillator);
+                
+                const ScopedLock sl (lock);
+                bool found = false;
+                for (auto& l : loaded)
+                {
+                    if (l.oscillator != request.oscillator) continue;
+                    l.data = data;
+                    found = true;
+                }
+                if (!found) loaded.add({ request.oscillator, data });
+            }
+            numOutstanding--;
+        }
+        
+        bool waiting = false;
+        for (auto oscillator : oscillators)
+        {
+            oscillator->collectWaveTables();
+            waiting = waiting || oscillator->isWaitingForWaveTables();
+        }
+        store->trim();
+        
+        // The audio thread doesn't signal when it picks up a set, so check
+        // back while any are still in flight
+        wait(waiting ? 50 : -1);
+    }
+}
+
+WaveTableData::Ptr WaveTableLoader::loadData(const File& file)
+{
+    Array<File> files = getSetFiles(file);
+    if (files.isEmpty()) return nullptr;
+    
+    // FNV-1a over the contents of every file in the set, seeded with the
+    // version so a format change never maps an old file
+    uint64 hash = 14695981039346656037ull ^ WAVETABLE_CACHE_VERSION;
+    HeapBlock<uint8> buffer (65536);
+    for (auto& f : files)
+    {
+        FileInputStream in (f);
+        if (!in.openedOk()) return nullptr;
+        
+        int numRead;
+        while ((numRead = in.read(buffer.get(), 65536)) > 0)
+        {
+            for (int i = 0; i < numRead; ++i)
+            {
+                hash = (hash ^ buffer[i]) * 1099511628211ull;
+            }
+        }
+        // Keep a split between files from hashing like a join
+        hash = (hash ^ 0xff) * 1099511628211ull;
+    }
+    if (WaveTableData::Ptr shared = store->find((int64)hash)) return shared;
+    
+    File cacheFile = getCacheDirectory().getChildFile(String::toHexString((int64)hash) + ".eswt");
+    
+    if (cacheFile.existsAsFile())
+    {
+        WaveTableData::Ptr data = new WaveTableData(cacheFile);
+        if (!data->isEmpty()) return store->add((int64)hash, data);
+    }
+    
+    Array<AudioBuffer<float>> frames;
+    for (auto& f : files) readFrames(f, frames);
+    if (frames.isEmpty()) return nullptr;
+    
+    WaveTableData::Ptr data = new WaveTableData(frames);
+    // Still usable if the cache can't be written
+    data->save(cacheFile);
+    return store->add((int64)hash, data);
+}
+
+Array<File> WaveTableLoader::getSetFiles(const File& file)
+{
+    // A directory is every .wav in it as one set
+    if (!file.isDirectory()) return { file };
+    
+    Array<File> files = file.findChildFiles(File::TypesOfFileToFind::findFiles, false, "*.wav");
+    files.sort();
+    return files;
+}
+
+void WaveTableLoader::readFrames(const File& file, Array<AudioBuffer<float>>& frames)
+{
+    std::unique_ptr<AudioFormatReader> reader (formatManager.createReaderFor(file));
+    if (reader == nullptr) return;
+    
+    jassert(reader->lengthInSamples % WAVETABLE_FRAME_SIZE == 0);
+    
+    for (int i = 0; i < reader->lengthInSamples / WAVETABLE_FRAME_SIZE; ++i)
+    {
+        frames.add(AudioBuffer<float>(reader->numChannels, WAVETABLE_FRAME_SIZE));
+        AudioBuffer<float>& frame = frames.getReference(frames.size()-1);
+        reader->read(&frame, 0, WAVETABLE_FRAME_SIZE, i * WAVETABLE_FRAME_SIZE, true, true);
+    }
+}
@@ -0,0 +1,289 @@
+/*
+  ==============================================================================
+
+    WaveTables.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Constants.h"
+
+class Oscillator;
+
+// Samples per frame of a wavetable file
+#define WAVETABLE_FRAME_SIZE 2048
+// Highest partial that gets through, in Hz
+#define WAVETABLE_MAX_FREQ 14000.f
+// Each level keeps half the harmonics of the one before, down to just the
+// fundamental
+#define WAVETABLE_NUM_LEVELS 11
+// Levels are stored twice oversampled, but none shorter than this
+#define WAVETABLE_MIN_LEVEL_SIZE 256
+// Bump whenever the cache layout or how levels are built changes
+#define WAVETABLE_CACHE_VERSION 1
+// Tables no oscillator is using are kept, for going back to, until the
+// total would pass this
+#define WAVETABLE_DEFAULT_MEMORY_BUDGET ((size_t)256 * 1024 * 1024)
+
+//==============================================================================
+// Passes objects built on another thread to the audio thread without either
+// side locking or waiting. The builder publishes into pending; at the top of
+// a block the audio thread swaps pending in as active and leaves the object
+// it was using in retired, and the builder frees it from there. Nothing is
+// freed while the audio thread might still be reading it, and the audio
+// thread never frees anything.
+template <typename ObjectType>
+class AudioThreadHandoff
+{
+public:
+    //==============================================================================
+    AudioThreadHandoff() = default;
+    
+    // Only once neither thread can touch it again
+    ~AudioThreadHandoff()
+    {
+        delete active;
+        delete pending.load();
+        delete retired.load();
+    }
+    
+    //==============================================================================
+    // Builder thread. Replaces anything the audio thread hasn't picked up yet
+    void publish(ObjectType* object)
+    {
+        delete pending.exchange(object, std::memory_order_acq_rel);
+    }
+    
+    // Builder thread. Frees whatever the audio thread has finished with
+    void collect()
+    {
+        delete retired.exchange(nullptr, std::memory_order_acq_rel);
+    }
+    
+    // True while something published is yet to be picked up or collected
+    bool isWaiting() const
+    {
+        return pending.load(std::memory_order_acquire) != nullptr ||
+        retired.load(std::memory_order_acquire) != nullptr;
+    }
+    
+    //==============================================================================
+    // Audio thread. Picks up the latest object if there is one and the last
+    // one retired has been collected, and returns the one to use
+    ObjectType* update()
+    {
+        if (pending.load(std::memory_order_relaxed) == nullptr ||
+            retired.load(std::memory_order_acquire) != nullptr) return active;
+        
+        if (ObjectType* next = pending.exchange(nullptr, std::memory_order_acq_rel))
+        {
+            retired.store(active, std::memory_order_release);
+            active = next;
+        }
+        return active;
+    }
+    
+    // Audio thread, or while the audio thread is stopped
+    ObjectType* get() const { return active; }
+    
+private:
+    ObjectType* active = nullptr;
+    std::atomic<ObjectType*> pending { nullptr };
+    std::atomic<ObjectType*> retired { nullptr };
+    
+    JUCE_DECLARE_NON_COPYABLE (AudioThreadHandoff)
+};
+
+//==============================================================================
+// Band-limited mipmaps of every frame in a wavetable set, in one block laid
+// out [frame][level][sample]. Level l keeps the harmonics up to
+// (WAVETABLE_FRAME_SIZE / 2) >> l, stored twice oversampled and followed by a
+// copy of its first sample so reads can interpolate without wrapping. None of
+// it depends on the sample rate, so it can be written to the cache once and
+// read straight back in. Never changes once built, so any number of
+// oscillators, strings and plugin instances can read the same copy.
+class WaveTableData : public ReferenceCountedObject
+{
+public:
+    //==============================================================================
+    using Ptr = ReferenceCountedObjectPtr<WaveTableData>;
+    
+    // Band-limits frames of WAVETABLE_FRAME_SIZE samples
+    explicit WaveTableData(const Array<AudioBuffer<float>>& frames);
+    // Reads a file written by save(); empty if it's missing or out of date
+    explicit WaveTableData(const File& cacheFile);
+    
+    bool isEmpty() const { return numFrames == 0; }
+    bool save(const File& cacheFile) const;
+    
+    size_t getSizeInBytes() const { return (size_t)numFrames * getFrameSize() * sizeof(float); }
+    
+    //==============================================================================
+    int getNumFrames() const { return numFrames; }
+    const float* getLevel(int frame, int level) const
+    {
+        return samples + (size_t)frame * getFrameSize() + getLevelOffset(level);
+    }
+    
+    // Interpolated sample at phase in [0, 1)
+    float read(int frame, int level, float phase) const
+    {
+        const float* table = getLevel(frame, level);
+        float position = phase * getLevelSize(level);
+        int i = (int)position;
+        float fraction = position - i;
+        return table[i] + (table[i+1] - table[i]) * fraction;
+    }
+    
+    //==============================================================================
+    static constexpr int getLevelSize(int level)
+    {
+        return ((2 * WAVETABLE_FRAME_SIZE) >> level) > WAVETABLE_MIN_LEVEL_SIZE ?
+        (2 * WAVETABLE_FRAME_SIZE) >> level : WAVETABLE_MIN_LEVEL_SIZE;
+    }
+    static constexpr int getLevelOffset(int level)
+    {
+        int offset = 0;
+        for (int l = 0; l < level; ++l) offset += getLevelSize(l) + 1;
+        return offset;
+    }
+    static constexpr int getFrameSize() { return getLevelOffset(WAVETABLE_NUM_LEVELS); }
+    
+private:
+    //==============================================================================
+    // Native byte order; 32 bytes so the samples after it stay aligned
+    struct CacheHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t frameSize;
+        uint32_t numLevels;
+        uint32_t numFrames;
+        uint32_t reserved[3];
+    };
+    
+    HeapBlock<float> allocated;
+    const float* samples = nullptr;
+    int numFrames = 0;
+    
+    JUCE_DECLARE_NON_COPYABLE (WaveTableData)
+};
+
+// What the loader hands an oscillator
+struct WaveTableSet
+{
+    File file;
+    WaveTableData::Ptr data;
+};
+
+//==============================================================================
+// The tables loaded anywhere in the process by content hash, so oscillators
+// and plugin instances loading the same files share them. Tables nothing
+// refers to any more stay until the total passes the memory budget, then go
+// least recently used first. Tables in use are never dropped, so the budget
+// can be passed while they're all playing. Only loader threads find, add or
+// trim, and they're also the only threads that release a reference, so
+// tables are never freed on the audio thread.
+class WaveTableStore
+{
+public:
+    //==============================================================================
+    WaveTableData::Ptr find(int64 hash);
+    // Returns what's stored, which is someone else's copy if they got there first
+    WaveTableData::Ptr add(int64 hash, WaveTableData::Ptr data);
+    // Frees unused tables until the rest fit the budget
+    void trim();
+    
+    //==============================================================================
+    void setMemoryBudget(size_t bytes) { memoryBudget = bytes; }
+    size_t getMemoryBudget() const { return memoryBudget; }
+    // Bytes of tables held, in use or not
+    size_t getMemoryUsage();
+    
+private:
+    //==============================================================================
+    struct Entry
+    {
+        WaveTableData::Ptr data;
+        int64 lastUsed;
+    };
+    
+    CriticalSection lock;
+    HashMap<int64, Entry> tables;
+    int64 useCount = 0;
+    size_t memoryUsage = 0;
+    std::atomic<size_t> memoryBudget { WAVETABLE_DEFAULT_MEMORY_BUDGET };
+};
+
+//==============================================================================
+// Reads wavetable files and builds their tables on a background thread,
+// handing each finished set to its oscillator through an AudioThreadHandoff
+// and freeing the sets the oscillators are done with. Built tables are cached
+// on disk by a hash of the files' contents, so a set that's been loaded before
+// only needs hashing and mapping.
+class WaveTableLoader : private Thread
+{
+public:
+    //==============================================================================
+    WaveTableLoader();
+    ~WaveTableLoader() override;
+    
+    //==============================================================================
+    // Queues file, a wavetable or a directory of them, to be built for
+    // oscillator. Replaces anything still queued for the same oscillator
+    void load(Oscillator& oscillator, const File& file);
+    
+    // Blocks until everything queued has been handed over, for offline
+    // renders that need the tables from the first sample
+    bool waitUntilLoaded(int timeoutMs);
+    
+    // The tables last handed to oscillator, which it's playing or about to,
+    // for reading off the audio thread
+    WaveTableData::Ptr getLoadedData(Oscillator& oscillator);
+    
+    // Must be called before any oscillator it has loaded for is destroyed
+    void stop();
+    
+    // For every instance in the process, since they share tables
+    void setMemoryBudget(size_t bytes);
+    size_t getMemoryBudget() { return store->getMemoryBudget(); }
+    size_t getMemoryUsage() { return store->getMemoryUsage(); }
+    
+    static File getCacheDirectory();
+    
+private:
+    //==============================================================================
+    struct Request
+    {
+        Oscillator* oscillator;
+        File file;
+    };
+    struct Loaded
+    {
+        Oscillator* oscillator;
+        WaveTableData::Ptr data;
+    };
+    
+    void run() override;
+    WaveTableData::Ptr loadData(const File& file);
+    void readFrames(const File& file, Array<AudioBuffer<float>>& frames);
+    // The .wav files a set is made of, in the order their frames go
+    static Array<File> getSetFiles(const File& file);
+    
+    AudioFormatManager formatManager;
+    
+    CriticalSection lock;
+    Array<Request> requests;
+    Array<Loaded> loaded;
+    std::atomic<int> numOutstanding { 0 };
+    
+    SharedResourcePointer<WaveTableStore> store;
+    
+    // Loader thread only
+    Array<Oscillator*> oscillators;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WaveTableLoader)
+};